@@ -0,0 +1,26 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <glm/glm.hpp>
+#include "INIReader.h"
+
+namespace Benchmark{
+  // A benchmark either replays a recording or follows a keyframed path, one line per keyframe:
+  // time posX posY posZ yaw pitch lightX lightY lightZ
+  struct Keyframe {
+    float time;
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    glm::vec3 light;
+  };
+
+  bool init(INIReader);
+  bool isEnabled();
+  float apply(unsigned int);
+  void capture(unsigned int);
+  bool advance(unsigned int);
+}
+
+#endif
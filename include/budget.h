@@ -0,0 +1,18 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include "INIReader.h"
+
+namespace Budget{
+  // Steers the smoothed frame time towards [budget] targetFrameTime by trading VPL regeneration against how often indirect light is updated.
+  // Outside the hysteresis band one knob moves per settle period, so the profiler's latency never drives a second step.
+  // The flag allows the controller at all, reference renders keep their full workload whatever the config says.
+  bool init(INIReader, unsigned int, bool);
+  bool isEnabled();
+  // Frame time, then VPL and indirect stage times in milliseconds, negative when not yet known.
+  void update(float, float, float);
+  unsigned int getVPLGenPerFrame();
+  unsigned int getIndirectInterval();
+}
+
+#endif
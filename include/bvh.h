@@ -0,0 +1,20 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace BVH{
+  // Depth-first layout shared with kernel.cl, the left child always follows its parent.
+  // Internal nodes keep the right child in min.w and zero in max.w,
+  // leaves keep their first triangle in min.w and their triangle count in max.w.
+  struct Node {
+    glm::vec4 min;
+    glm::vec4 max;
+  };
+
+  void build(const std::vector<glm::vec4>&, std::vector<Node>&, std::vector<glm::vec4>&, std::vector<unsigned int>&);
+  void refit(const std::vector<glm::vec4>&, const std::vector<unsigned int>&, std::vector<Node>&, std::vector<glm::vec4>&);
+}
+
+#endif
@@ -13,6 +13,10 @@ namespace Camera{
   void update(float);
   glm::mat4 getViewMatrix();
   glm::vec3 getPosition();
+  void getPose(glm::vec3&, float&, float&);
+  void setPose(glm::vec3, float, float);
+  // Whether the last update moved or turned the view.
+  bool isMoving();
 };
 
 #endif
@@ -0,0 +1,16 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <vector>
+#include "INIReader.h"
+
+namespace HUD{
+  // Everything is drawn as flat coloured quads from one buffer in a single draw call,
+  // text included, using a built-in 3x5 pixel font.
+  bool init(INIReader, unsigned int, unsigned int, unsigned int);
+  void addFrameTime(float);
+  void draw(const std::vector<unsigned int>&, unsigned int, unsigned int, double);
+  void destroy();
+}
+
+#endif
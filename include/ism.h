@@ -0,0 +1,20 @@
+#ifndef ISM_H
+#define ISM_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace ISM{
+  // A point sample stored against its triangle so it follows the mesh when dynamic meshes move.
+  struct Sample {
+    unsigned int triangle;
+    float u;
+    float v;
+  };
+
+  void sample(const std::vector<glm::vec4>&, unsigned int, std::vector<Sample>&);
+  void place(const std::vector<glm::vec4>&, const std::vector<Sample>&, std::vector<glm::vec4>&);
+  unsigned int getTilesPerRow(unsigned int);
+}
+
+#endif
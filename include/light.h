@@ -0,0 +1,22 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include <glm/glm.hpp>
+
+struct Light {
+	glm::vec4 position;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	glm::vec4 normal;
+};
+
+struct LightExtra {
+	unsigned int type;
+	glm::vec2 quad;
+	float angle;
+	unsigned int fbo;
+	unsigned int map;
+	glm::mat4 projection;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef LIGHTTREE_H
+#define LIGHTTREE_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "light.h"
+
+namespace LightTree{
+  // Node layout shared with iplane.fsh and kernel.cl, five texels per node.
+  // Child, parent and top indices are relative to the start of their tree.
+  struct Node {
+    glm::vec4 position; // representative position, w = path distance to its light
+    glm::vec4 diffuse;  // summed diffuse of the cluster, w = representative VPL index
+    glm::vec4 min;      // w = left child, -1 for leaves
+    glm::vec4 max;      // w = right child
+    glm::vec4 link;     // x = parent, y = highest ancestor sharing this representative
+  };
+
+  unsigned int getTreeSize(unsigned int);
+  unsigned int getRoot(unsigned int);
+  void build(const std::vector<Light>&, const std::vector<unsigned int>&, const std::vector<float>&, float, std::vector<Node>&);
+}
+
+#endif
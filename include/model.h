@@ -1,20 +1,37 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <vector>
 #include "INIReader.h"
 #include "radeon_rays.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 namespace Model{
+  // Structure of arrays filled by getSurfaces, entry i belongs to hit i.
+  struct Surfaces {
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz;
+    std::vector<float> r, g, b;
+  };
+
   bool init(INIReader, RadeonRays::IntersectionApi*);
   void draw(unsigned int);
   void update(float);
   void destroy();
+  void attach(RadeonRays::IntersectionApi*, float);
+  void updateAttached(RadeonRays::IntersectionApi*, float);
+  void addMesh(const std::vector<glm::vec3>&, const std::vector<glm::vec3>&, const std::vector<glm::vec2>&, glm::vec3);
   glm::mat4 getModelMatrix();
   glm::vec4 getDiffuse(unsigned int, unsigned int, float, float);
   glm::vec4 getSpecular(unsigned int, unsigned int, float, float);
   glm::vec4 getNormal(unsigned int, unsigned int, float, float);
+  void getSurfaces(const RadeonRays::Intersection*, const RadeonRays::ray*, unsigned int, Surfaces&);
+  void getTriangles(std::vector<glm::vec4>&);
+  bool hasDynamicMeshes();
+  bool getDynamicBounds(float, float, glm::vec3&, glm::vec3&);
+  float getTime();
+  void setTime(float);
 	std::string getTimeIntervals();
 }
 
@@ -0,0 +1,49 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <CL/cl.h>
+#include "INIReader.h"
+
+// Queries are kept in a ring and read back this many frames late so nothing stalls the pipeline.
+#define PROFILER_LATENCY 4
+
+namespace Profiler{
+  void init(cl_command_queue, INIReader);
+  unsigned int addStage(const std::string&);
+  void enableStatistics(unsigned int);
+  // Counters sum whatever is counted per frame, giving a stage also reports the rate over its time.
+  unsigned int addCounter(const std::string&, int = -1);
+  void count(unsigned int, double);
+  double getCounterTotal(unsigned int);
+  void beginFrame();
+  void beginGL(unsigned int);
+  void endGL(unsigned int);
+  void beginCL(unsigned int);
+  void endCL(unsigned int);
+  void beginCPU(unsigned int);
+  void endCPU(unsigned int);
+  void recordCPU(unsigned int, float);
+  float getAverage(unsigned int);
+  float getLatest(unsigned int);
+  bool isLatestGPU(unsigned int);
+  double getLatestCount(unsigned int);
+  const std::string& getName(unsigned int);
+  unsigned int getNoOfStages();
+  void flush();
+  void reset();
+  void setCapacity(unsigned int);
+  std::vector<float> getFrameTimes();
+  std::vector<float> getDurations(unsigned int);
+  std::vector<double> getCounts(unsigned int);
+  float percentile(std::vector<float>&, float);
+  std::string getSummary();
+  bool exportCSV(const std::string&);
+  bool exportTrace(const std::string&);
+  void exportAll();
+  void destroy();
+}
+
+#endif
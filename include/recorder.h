@@ -0,0 +1,31 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <string>
+#include <vector>
+#include <SDL2/SDL.h>
+#include <glm/glm.hpp>
+#include "INIReader.h"
+
+namespace Recorder{
+  // Everything needed to replay a frame bit-exactly, captured after input has been applied.
+  struct Frame {
+    float deltaTime;
+    float modelTime;
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    unsigned int toggles;
+    int debugVPL;
+    std::vector<glm::vec3> lights;
+  };
+
+  bool init(INIReader);
+  void processSDLEvent(SDL_Event);
+  void capture(float, float);
+  bool load(const std::string&, std::vector<Frame>&);
+  void apply(const Frame&);
+  void destroy();
+}
+
+#endif
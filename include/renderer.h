@@ -7,11 +7,24 @@
 #include <glm/glm.hpp>
 #include <SDL2/SDL.h>
 
+#define TOGGLE_DIRECT 1
+#define TOGGLE_INDIRECT 2
+#define TOGGLE_VPL_DEBUG 4
+#define TOGGLE_ADAPTIVE_DEBUG 8
+#define TOGGLE_HUD 16
+
 namespace renderer{
   bool init(INIReader);
   RadeonRays::IntersectionApi* getIntersectionApi();
   glm::vec3 randomDirection(unsigned int);
   void processSDLEvent(SDL_Event);
+  unsigned int getNoOfLights();
+  glm::vec3 getLightPosition(unsigned int);
+  void setLightPosition(unsigned int, glm::vec3);
+  unsigned int getToggles();
+  void setToggles(unsigned int);
+  int getDebugVPL();
+  void setDebugVPL(int);
   void update(float);
   void destroy();
 	std::string getTimeIntervals();
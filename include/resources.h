@@ -0,0 +1,22 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <string>
+#include <GL/glew.h>
+#include <CL/cl.h>
+#include "INIReader.h"
+
+namespace Resources{
+  // Registering a name again replaces its size, so reallocations are tracked rather than added up.
+  // Allocations are registered before they are made so the budget warning comes first.
+  void init(INIReader, cl_device_id);
+  void add(const std::string&, const std::string&, const std::string&, const std::string&, size_t);
+  void addTexture(const std::string&, const std::string&, GLenum, unsigned int, unsigned int, unsigned int);
+  void addRenderbuffer(const std::string&, const std::string&, GLenum, unsigned int, unsigned int);
+  void addBuffer(const std::string&, const std::string&, const std::string&, size_t);
+  size_t getTotal();
+  size_t getBudget();
+  std::string getSummary(bool);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+
+#define SAMPLER_HALTON 0
+#define SAMPLER_SOBOL 1
+#define SAMPLER_MAX_DIMENSIONS 4
+
+namespace Sampler{
+  // Low-discrepancy sequence advanced in place, so drawing a sample never allocates.
+  // Halton steps each radical inverse incrementally, Sobol flips one direction vector per sample in Gray-code order.
+  // The seed scrambles the sequence, giving every light its own decorrelated stream.
+  struct Sequence {
+    unsigned int type;
+    uint32_t index;
+    uint32_t scramble[SAMPLER_MAX_DIMENSIONS];
+    uint32_t sobol[SAMPLER_MAX_DIMENSIONS];
+    double halton[SAMPLER_MAX_DIMENSIONS];
+  };
+
+  Sequence create(unsigned int, uint32_t, uint32_t);
+  void skipTo(Sequence&, uint32_t);
+  void next(Sequence&, unsigned int, float*);
+  // Structure of arrays, dimension d of sample i lands in out[d * n + i].
+  void generate(Sequence&, unsigned int, unsigned int, float*);
+  double radicalInverse(unsigned int, uint32_t);
+}
+
+#endif
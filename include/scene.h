@@ -0,0 +1,22 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+#include <SDL2/SDL.h>
+#include "INIReader.h"
+#include "tiny_obj_loader.h"
+#include "light.h"
+
+namespace Scene{
+  // Procedural stand-in for an obj file, every dimension comes from [synthetic] so sweeps can vary one at a time.
+  // Rooms sit on a square grid centred on the origin, each with a floor, ceiling, doorways and a grid of pillars.
+  bool isEnabled(INIReader);
+  void generate(INIReader, tinyobj::attrib_t&, std::vector<tinyobj::shape_t>&, std::vector<tinyobj::material_t>&);
+  void generateLights(INIReader, std::vector<Light>&, std::vector<LightExtra>&);
+  // Textures are named synthetic:<material>:<size> and rasterised on load instead of read from disk.
+  bool isTexture(const std::string&);
+  SDL_Surface* createTexture(const std::string&);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Single producer, single consumer hand-off where neither side ever waits.
+// The producer fills back() and publishes it, the consumer swaps in the newest published slot on update().
+// Slots are reused, so once their vectors have grown nothing allocates.
+template <typename T>
+class TripleBuffer {
+public:
+  T& back() { return slots[backIndex]; }
+  const T& front() const { return slots[frontIndex]; }
+
+  void publish() {
+    backIndex = middle.exchange(backIndex | TRIPLEBUFFER_FRESH) & TRIPLEBUFFER_INDEX;
+  }
+
+  // Returns false when nothing newer than front() has been published.
+  bool update() {
+    if (!(middle.load() & TRIPLEBUFFER_FRESH))
+      return false;
+    frontIndex = middle.exchange(frontIndex) & TRIPLEBUFFER_INDEX;
+    return true;
+  }
+
+private:
+  static const unsigned int TRIPLEBUFFER_FRESH = 4;
+  static const unsigned int TRIPLEBUFFER_INDEX = 3;
+  T slots[3];
+  std::atomic<unsigned int> middle{ 1 };
+  unsigned int backIndex = 0;
+  unsigned int frontIndex = 2;
+};
+
+#endif
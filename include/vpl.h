@@ -0,0 +1,42 @@
+#ifndef VPL_H
+#define VPL_H
+
+#include <cstdint>
+#include <vector>
+#include "radeon_rays.h"
+#include "light.h"
+
+namespace VPL{
+  // CPU side of VPL validation, kept free of GL and CL so it can be benchmarked in isolation.
+  // VPL i bounces off VPL i - perBounce, first bounces (i < perBounce) off light i % noOfLights.
+  // Positions and normals are mirrored here as structure of arrays so the validation kernels run four VPLs per SSE op;
+  // a bounce level's parents are the previous level shifted by perBounce, first bounce parents are gathered per slot by setLights.
+  struct Store {
+    unsigned int size;
+    unsigned int perBounce;
+    std::vector<float> x, y, z, nx, ny, nz;
+    std::vector<float> pathDist;
+    std::vector<float> lx, ly, lz, lnx, lny, lnz, lCone, lQuadX, lQuadY, lInvHypSin;
+    std::vector<int> lType;
+    std::vector<uint64_t> valid;
+    // VPLs whose ray has to be traced again because they, their parent or geometry across the ray moved.
+    std::vector<uint64_t> dirty;
+  };
+
+  float getQuadLightDistance(const Light&, const Light&);
+  void init(Store&, unsigned int, unsigned int);
+  void setLights(Store&, const std::vector<Light>&, const std::vector<LightExtra>&);
+  void set(Store&, unsigned int, const Light&, float);
+  bool isValid(const Store&, unsigned int);
+  void setValid(Store&, unsigned int, bool);
+  bool isDirty(const Store&, unsigned int);
+  void setDirty(Store&, unsigned int);
+  void clearDirty(Store&);
+  unsigned int getNoOfValid(const Store&);
+  void buildValidationRays(const Store&, float, std::vector<RadeonRays::ray>&);
+  void markCrossing(Store&, const std::vector<RadeonRays::ray>&, const glm::vec3&, const glm::vec3&);
+  unsigned int compactDirty(const Store&, std::vector<RadeonRays::ray>&, std::vector<unsigned int>&);
+  unsigned int invalidate(Store&, const int*);
+}
+
+#endif
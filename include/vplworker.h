@@ -0,0 +1,43 @@
+#ifndef VPLWORKER_H
+#define VPLWORKER_H
+
+#include <vector>
+#include <CL/cl.h>
+#include "INIReader.h"
+#include "radeon_rays.h"
+#include "light.h"
+
+namespace VPLWorker{
+  // VPL validation and shooting, either inline on submit or on a thread with its own intersection api.
+  // Jobs go in and VPL sets come out through triple buffers, so the render thread never waits on the worker.
+  struct Job {
+    std::vector<Light> pls;
+    std::vector<LightExtra> plexs;
+    unsigned int historyIndex;
+    float modelTime;
+  };
+
+  // generation only changes when the VPLs did, results in between may be dropped.
+  struct Result {
+    std::vector<Light> vpls;
+    unsigned int generation;
+    unsigned int noOfInvalid;
+    unsigned int noOfValidationRays;
+    unsigned int noOfValidationOccluded;
+    unsigned int noOfShootingRays;
+    unsigned int noOfShootingHits;
+    float validationTime;
+    float shootingTime;
+  };
+
+  bool init(INIReader, cl_context, cl_device_id, RadeonRays::IntersectionApi*, const std::vector<Light>&, unsigned int, unsigned int, unsigned int, bool);
+  Job& getJob();
+  void submit();
+  const Result* acquire();
+  void setMaxGenPerFrame(unsigned int);
+  unsigned int getMaxGenPerFrame();
+  bool isThreaded();
+  void destroy();
+}
+
+#endif
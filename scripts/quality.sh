@@ -0,0 +1,51 @@
+#!/bin/sh
+#Renders the benchmark path with the brute-force reference and the configured
+#renderer, then scores every captured frame against the reference.
+#summary.csv puts the mean error next to both runs' mean frame and stage times.
+#Run from the directory holding the shaders and scenes.
+#Usage: scripts/quality.sh <protogee> <protogee_compare> [config] [output dir]
+set -e
+
+PROTOGEE=${1:?protogee binary}
+COMPARE=${2:?protogee_compare binary}
+CONFIG=${3:-config.ini}
+OUT=${4:-quality}
+
+mkdir -p "$OUT/reference" "$OUT/candidate"
+OUT=$(cd "$OUT" && pwd)
+
+configure() {
+	sed -e "/^\[benchmark\]/,/^\[/ s|^enabled *=.*|enabled = 1|" \
+		-e "/^\[benchmark\]/,/^\[/ s|^captureDir *=.*|captureDir = $OUT/$1|" \
+		-e "/^\[benchmark\]/,/^\[/ s|^report *=.*|report = $OUT/$1/benchmark.json|" \
+		-e "/^\[renderer\]/,/^\[/ s|^reference *=.*|reference = $2|" \
+		"$CONFIG" > "$OUT/$1.ini"
+}
+
+configure reference 1
+configure candidate 0
+
+"$PROTOGEE" . "$OUT/reference.ini"
+"$PROTOGEE" . "$OUT/candidate.ini"
+
+echo "frame,rmse,ssim,flip" > "$OUT/quality.csv"
+for reference in "$OUT"/reference/frame_*.ppm; do
+	frame=$(basename "$reference" .ppm)
+	echo "${frame#frame_},$("$COMPARE" "$reference" "$OUT/candidate/$frame.ppm")" >> "$OUT/quality.csv"
+done
+
+stages() {
+	sed -n -e "s|^,*\"\([^\"]*\)\":{\"samples\":[0-9]*,\"mean\":\([^,]*\),.*|\1,\2|p" "$OUT/$1/benchmark.json"
+}
+
+stages reference > "$OUT/reference/stages.csv"
+stages candidate > "$OUT/candidate/stages.csv"
+{
+	echo "metric,reference,candidate"
+	awk -F, 'NR > 1 { rmse += $2; ssim += $3; flip += $4; n++ }
+		END { if (n) printf "rmse,0,%g\nssim,1,%g\nflip,0,%g\n", rmse / n, ssim / n, flip / n }' "$OUT/quality.csv"
+	awk -F, 'NR == FNR { reference[$1] = $2; next }
+		{ printf "%s,%s,%s\n", $1, ($1 in reference) ? reference[$1] : "", $2; delete reference[$1] }
+		END { for (stage in reference) printf "%s,%s,\n", stage, reference[stage] }' \
+		"$OUT/reference/stages.csv" "$OUT/candidate/stages.csv"
+} > "$OUT/summary.csv"
@@ -0,0 +1,29 @@
+#!/bin/sh
+#Benchmarks the synthetic scene once per value of a single [synthetic] key and
+#collects the mean frame and stage times into one long-format csv.
+#Run from the directory holding the shaders.
+#Usage: scripts/sweep.sh <protogee> <key> <value>... (CONFIG, OUT override config.ini, sweep)
+set -e
+
+PROTOGEE=${1:?protogee binary}
+KEY=${2:?synthetic key, e.g. rooms}
+shift 2
+CONFIG=${CONFIG:-config.ini}
+OUT=${OUT:-sweep}
+
+mkdir -p "$OUT"
+OUT=$(cd "$OUT" && pwd)
+
+echo "$KEY,stage,mean" > "$OUT/$KEY.csv"
+for value in "$@"; do
+	sed -e "/^\[benchmark\]/,/^\[/ s|^enabled *=.*|enabled = 1|" \
+		-e "/^\[benchmark\]/,/^\[/ s|^report *=.*|report = $OUT/${KEY}_$value.json|" \
+		-e "/^\[synthetic\]/,/^\[/ s|^enabled *=.*|enabled = 1|" \
+		-e "/^\[synthetic\]/,/^\[/ s|^$KEY *=.*|$KEY = $value|" \
+		"$CONFIG" > "$OUT/${KEY}_$value.ini"
+
+	"$PROTOGEE" . "$OUT/${KEY}_$value.ini"
+
+	sed -n -e "s|^,*\"\([^\"]*\)\":{\"samples\":[0-9]*,\"mean\":\([^,]*\),.*|$value,\1,\2|p" \
+		"$OUT/${KEY}_$value.json" >> "$OUT/$KEY.csv"
+done
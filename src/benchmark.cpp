@@ -0,0 +1,199 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <numeric>
+#include <set>
+#include <iomanip>
+#include <stdexcept>
+#include <GL/glew.h>
+
+#include "benchmark.h"
+#include "camera.h"
+#include "renderer.h"
+#include "profiler.h"
+#include "recorder.h"
+
+namespace {
+bool benchmarkEnabled = false;
+std::vector<Benchmark::Keyframe> keyframes;
+std::vector<Recorder::Frame> recordedFrames;
+std::string pathFile;
+std::string reportPath;
+unsigned int warmupFrames;
+unsigned int measuredFrames;
+float timestep;
+int benchmarkWidth;
+int benchmarkHeight;
+std::set<unsigned int> captureFrames;
+std::string captureDir;
+
+bool loadPath(const std::string& path) {
+	std::ifstream file(path.c_str());
+	if (!file.is_open()) {
+		std::cerr << "Failed to open benchmark path " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		std::istringstream stream(line);
+		Benchmark::Keyframe key;
+		stream >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch >> key.light.x >> key.light.y >> key.light.z;
+		if (stream.fail()) {
+			std::cerr << "Malformed benchmark keyframe : " << line << std::endl;
+			return false;
+		}
+		if (!keyframes.empty() && key.time <= keyframes.back().time) {
+			std::cerr << "Benchmark keyframes must be in increasing time order" << std::endl;
+			return false;
+		}
+		keyframes.push_back(key);
+	}
+	if (keyframes.empty()) {
+		std::cerr << "Benchmark path " << path << " has no keyframes" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void writeStatistics(std::ofstream& file, std::vector<float> values) {
+	float mean = values.empty() ? 0 : std::accumulate(values.begin(), values.end(), 0.f) / values.size();
+	file << "{\"samples\":" << values.size() << ",\"mean\":" << mean;
+	file << ",\"p50\":" << Profiler::percentile(values, 0.5f);
+	file << ",\"p95\":" << Profiler::percentile(values, 0.95f);
+	file << ",\"p99\":" << Profiler::percentile(values, 0.99f);
+	file << ",\"max\":" << Profiler::percentile(values, 1.f) << "}";
+}
+
+bool writeReport() {
+	std::ofstream file(reportPath.c_str());
+	if (!file.is_open()) {
+		std::cerr << "Failed to open benchmark report " << reportPath << std::endl;
+		return false;
+	}
+	file << "{" << std::endl;
+	file << "\"path\":\"" << pathFile << "\"," << std::endl;
+	file << "\"width\":" << benchmarkWidth << ",\"height\":" << benchmarkHeight << "," << std::endl;
+	file << "\"warmup\":" << warmupFrames << ",\"frames\":" << measuredFrames << ",\"timestep\":" << timestep << "," << std::endl;
+	file << "\"frameTime\":";
+	writeStatistics(file, Profiler::getFrameTimes());
+	file << "," << std::endl << "\"stages\":{" << std::endl;
+	bool first = true;
+	for (unsigned int s = 0; s < Profiler::getNoOfStages(); ++s) {
+		std::vector<float> durations = Profiler::getDurations(s);
+		if (durations.empty())
+			continue;
+		file << (first ? "" : ",\n") << "\"" << Profiler::getName(s) << "\":";
+		writeStatistics(file, durations);
+		first = false;
+	}
+	file << std::endl << "}" << std::endl << "}" << std::endl;
+	return true;
+}
+}
+
+bool Benchmark::init(INIReader config) {
+	benchmarkEnabled = config.GetBoolean("benchmark", "enabled", false);
+	if (!benchmarkEnabled)
+		return true;
+
+	pathFile = config.Get("benchmark", "recording", "");
+	bool replay = !pathFile.empty();
+	if (!replay)
+		pathFile = config.Get("benchmark", "path", "benchmark.path");
+	reportPath = config.Get("benchmark", "report", "benchmark.json");
+	warmupFrames = config.GetInteger("benchmark", "warmup", 60);
+	measuredFrames = config.GetInteger("benchmark", "frames", 600);
+	timestep = config.GetReal("benchmark", "timestep", 1 / 60.f);
+	benchmarkWidth = config.GetInteger("interface", "width", 480);
+	benchmarkHeight = config.GetInteger("interface", "height", 320);
+	captureDir = config.Get("benchmark", "captureDir", ".");
+	std::stringstream captures(config.Get("benchmark", "captureFrames", ""));
+	std::string capture;
+	while (std::getline(captures, capture, ',')) {
+		try {
+			captureFrames.insert(std::stoul(capture));
+		}
+		catch (const std::exception&) {
+			std::cerr << "Malformed benchmark captureFrames entry : " << capture << std::endl;
+			return false;
+		}
+	}
+	if (replay) {
+		if (!Recorder::load(pathFile, recordedFrames))
+			return false;
+		if (recordedFrames.size() <= warmupFrames) {
+			std::cerr << "Recording " << pathFile << " is shorter than the warm-up" << std::endl;
+			return false;
+		}
+		//A recording is replayed once, so it sets the length of the run
+		measuredFrames = recordedFrames.size() - warmupFrames;
+	}
+	else if (!loadPath(pathFile)) {
+		return false;
+	}
+
+	//Every measured frame has to fit in the trace for the report percentiles to be exact
+	Profiler::setCapacity(measuredFrames);
+	return true;
+}
+
+bool Benchmark::isEnabled() {
+	return benchmarkEnabled;
+}
+
+//Poses are a pure function of the frame number so every run sees the same sequence, returns the frame's timestep
+float Benchmark::apply(unsigned int frame) {
+	if (!recordedFrames.empty()) {
+		const Recorder::Frame& recorded = recordedFrames[glm::min(frame, (unsigned int)recordedFrames.size() - 1)];
+		Recorder::apply(recorded);
+		return recorded.deltaTime;
+	}
+
+	float time = frame * timestep;
+	unsigned int next = 0;
+	while (next < keyframes.size() && keyframes[next].time < time)
+		++next;
+	const Keyframe& b = keyframes[glm::min(next, (unsigned int)keyframes.size() - 1)];
+	const Keyframe& a = keyframes[next > 0 ? next - 1 : 0];
+	float t = b.time > a.time ? glm::clamp((time - a.time) / (b.time - a.time), 0.f, 1.f) : 0.f;
+
+	Camera::setPose(glm::mix(a.position, b.position, t), glm::mix(a.yaw, b.yaw, t), glm::mix(a.pitch, b.pitch, t));
+	renderer::setLightPosition(0, glm::mix(a.light, b.light, t));
+	return timestep;
+}
+
+//Reads back the finished frame before it is swapped and writes it as a binary PPM
+void Benchmark::capture(unsigned int frame) {
+	if (captureFrames.count(frame) == 0)
+		return;
+	std::vector<unsigned char> pixels(benchmarkWidth * benchmarkHeight * 3);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, benchmarkWidth, benchmarkHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+	std::stringstream path;
+	path << captureDir << "/frame_" << std::setw(5) << std::setfill('0') << frame << ".ppm";
+	std::ofstream file(path.str().c_str(), std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open capture " << path.str() << std::endl;
+		return;
+	}
+	file << "P6\n" << benchmarkWidth << " " << benchmarkHeight << "\n255\n";
+	for (int y = benchmarkHeight - 1; y >= 0; --y)
+		file.write(reinterpret_cast<const char*>(&pixels[y * benchmarkWidth * 3]), benchmarkWidth * 3);
+}
+
+//Returns false once the run is over, after writing the report
+bool Benchmark::advance(unsigned int frame) {
+	if (frame == warmupFrames)
+		Profiler::reset();
+	if (frame < warmupFrames + measuredFrames)
+		return true;
+	Profiler::flush();
+	writeReport();
+	return false;
+}
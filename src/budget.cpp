@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <iostream>
+
+#include "budget.h"
+
+namespace {
+bool budgetEnabled = false;
+float targetFrameTime;
+float hysteresis;
+float smoothing;
+unsigned int settleFrames;
+unsigned int minVPLGen, maxVPLGen;
+unsigned int maxIndirectInterval;
+
+float smoothedFrameTime;
+float indirectTime;
+unsigned int framesSinceChange;
+unsigned int vplGen;
+unsigned int indirectInterval;
+}
+
+bool Budget::init(INIReader config, unsigned int vplGenPerFrame, bool allowed) {
+	budgetEnabled = allowed && config.GetBoolean("budget", "enabled", false);
+	targetFrameTime = config.GetReal("budget", "targetFrameTime", 1000 / 60.f);
+	hysteresis = config.GetReal("budget", "hysteresis", 0.1f);
+	smoothing = config.GetReal("budget", "smoothing", 0.1f);
+	settleFrames = std::max((int)config.GetInteger("budget", "settleFrames", 10), 1);
+	maxVPLGen = vplGenPerFrame;
+	minVPLGen = std::min(std::max((unsigned int)config.GetInteger("budget", "minVPLGenPerFrame", 1), 1u), maxVPLGen);
+	maxIndirectInterval = std::max((int)config.GetInteger("budget", "maxIndirectInterval", 4), 1);
+	if (targetFrameTime <= 0) {
+		std::cerr << "Budget target frame time must be positive" << std::endl;
+		return false;
+	}
+
+	smoothedFrameTime = targetFrameTime;
+	indirectTime = 0;
+	framesSinceChange = 0;
+	vplGen = maxVPLGen;
+	indirectInterval = 1;
+	return true;
+}
+
+bool Budget::isEnabled() {
+	return budgetEnabled;
+}
+
+void Budget::update(float frameTime, float vplTime, float indirectUpdateTime) {
+	if (!budgetEnabled)
+		return;
+	smoothedFrameTime += smoothing * (frameTime - smoothedFrameTime);
+	//Indirect stages only run on update frames, so keep the cost of the last one seen
+	if (indirectUpdateTime > 0)
+		indirectTime = indirectUpdateTime;
+	if (++framesSinceChange < settleFrames)
+		return;
+
+	if (smoothedFrameTime > targetFrameTime * (1 + hysteresis)) {
+		//Cut whichever costs more per frame, regeneration shrinks by a quarter so large budgets converge quickly
+		bool cutVPLs = std::max(vplTime, 0.f) >= indirectTime / indirectInterval;
+		if ((cutVPLs || indirectInterval == maxIndirectInterval) && vplGen > minVPLGen)
+			vplGen = std::max(minVPLGen, vplGen * 3 / 4);
+		else if (indirectInterval < maxIndirectInterval)
+			indirectInterval++;
+		else
+			return;
+		framesSinceChange = 0;
+	}
+	else if (smoothedFrameTime < targetFrameTime * (1 - hysteresis)) {
+		//Stale indirect light is the more visible loss, so its rate is restored first
+		if (indirectInterval > 1)
+			indirectInterval--;
+		else if (vplGen < maxVPLGen)
+			vplGen = std::min(maxVPLGen, vplGen + std::max(vplGen / 4, 1u));
+		else
+			return;
+		framesSinceChange = 0;
+	}
+}
+
+unsigned int Budget::getVPLGenPerFrame() {
+	return vplGen;
+}
+
+unsigned int Budget::getIndirectInterval() {
+	return indirectInterval;
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cfloat>
+
+#include "bvh.h"
+
+#define BVH_NO_OF_BINS 12
+#define BVH_MAX_LEAF_SIZE 4
+//The packet traversal in kernel.cl keeps one pending sibling per level, past this depth nodes become leaves so its stack never overflows
+#define BVH_MAX_DEPTH 126
+
+namespace {
+struct Bounds {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	void grow(glm::vec3 p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void grow(const Bounds& b) {
+		min = glm::min(min, b.min);
+		max = glm::max(max, b.max);
+	}
+
+	float area() const {
+		glm::vec3 e = max - min;
+		return e.x < 0 ? 0 : 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+};
+
+Bounds triangleBounds(const std::vector<glm::vec4>& triangles, unsigned int t) {
+	Bounds b;
+	b.grow(glm::vec3(triangles[t * 3 + 0]));
+	b.grow(glm::vec3(triangles[t * 3 + 1]));
+	b.grow(glm::vec3(triangles[t * 3 + 2]));
+	return b;
+}
+
+unsigned int buildNode(const std::vector<Bounds>& bounds, const std::vector<glm::vec3>& centroids, std::vector<unsigned int>& order, unsigned int begin, unsigned int end, unsigned int depth, std::vector<BVH::Node>& nodes) {
+	unsigned int index = nodes.size();
+	nodes.push_back(BVH::Node());
+
+	Bounds nodeBounds;
+	Bounds centroidBounds;
+	for (unsigned int i = begin; i < end; ++i) {
+		nodeBounds.grow(bounds[order[i]]);
+		centroidBounds.grow(centroids[order[i]]);
+	}
+
+	unsigned int count = end - begin;
+	unsigned int mid = begin;
+	bool leaf = count <= BVH_MAX_LEAF_SIZE || depth >= BVH_MAX_DEPTH;
+	if (!leaf) {
+		//Binned SAH over the widest centroid axis
+		glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		if (extent[axis] > 0) {
+			Bounds bins[BVH_NO_OF_BINS];
+			unsigned int binCounts[BVH_NO_OF_BINS] = { 0 };
+			float scale = BVH_NO_OF_BINS / extent[axis];
+			for (unsigned int i = begin; i < end; ++i) {
+				int b = glm::min((int)((centroids[order[i]][axis] - centroidBounds.min[axis]) * scale), BVH_NO_OF_BINS - 1);
+				bins[b].grow(bounds[order[i]]);
+				binCounts[b]++;
+			}
+
+			float bestCost = FLT_MAX;
+			int bestSplit = -1;
+			for (int s = 1; s < BVH_NO_OF_BINS; ++s) {
+				Bounds left, right;
+				unsigned int leftCount = 0, rightCount = 0;
+				for (int b = 0; b < s; ++b) {
+					left.grow(bins[b]);
+					leftCount += binCounts[b];
+				}
+				for (int b = s; b < BVH_NO_OF_BINS; ++b) {
+					right.grow(bins[b]);
+					rightCount += binCounts[b];
+				}
+				if (leftCount == 0 || rightCount == 0)
+					continue;
+				float cost = left.area() * leftCount + right.area() * rightCount;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestSplit = s;
+				}
+			}
+
+			if (bestSplit != -1) {
+				mid = std::partition(order.begin() + begin, order.begin() + end, [&](unsigned int t) {
+					return glm::min((int)((centroids[t][axis] - centroidBounds.min[axis]) * scale), BVH_NO_OF_BINS - 1) < bestSplit;
+				}) - order.begin();
+			}
+		}
+		if (mid == begin || mid == end) {
+			mid = (begin + end) / 2;
+			std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](unsigned int a, unsigned int b) {
+				return centroids[a][axis] < centroids[b][axis];
+			});
+		}
+	}
+
+	if (leaf) {
+		nodes[index].min = glm::vec4(nodeBounds.min, begin);
+		nodes[index].max = glm::vec4(nodeBounds.max, count);
+		return index;
+	}
+
+	buildNode(bounds, centroids, order, begin, mid, depth + 1, nodes);
+	unsigned int right = buildNode(bounds, centroids, order, mid, end, depth + 1, nodes);
+	nodes[index].min = glm::vec4(nodeBounds.min, right);
+	nodes[index].max = glm::vec4(nodeBounds.max, 0);
+	return index;
+}
+}
+
+void BVH::build(const std::vector<glm::vec4>& triangles, std::vector<Node>& nodes, std::vector<glm::vec4>& ordered, std::vector<unsigned int>& order) {
+	unsigned int noOfTriangles = triangles.size() / 3;
+	std::vector<Bounds> bounds(noOfTriangles);
+	std::vector<glm::vec3> centroids(noOfTriangles);
+	order.resize(noOfTriangles);
+	for (unsigned int t = 0; t < noOfTriangles; ++t) {
+		bounds[t] = triangleBounds(triangles, t);
+		centroids[t] = (bounds[t].min + bounds[t].max) * 0.5f;
+		order[t] = t;
+	}
+
+	nodes.clear();
+	nodes.reserve(2 * noOfTriangles);
+	if (noOfTriangles > 0)
+		buildNode(bounds, centroids, order, 0, noOfTriangles, 0, nodes);
+
+	ordered.resize(triangles.size());
+	for (unsigned int t = 0; t < noOfTriangles; ++t) {
+		ordered[t * 3 + 0] = triangles[order[t] * 3 + 0];
+		ordered[t * 3 + 1] = triangles[order[t] * 3 + 1];
+		ordered[t * 3 + 2] = triangles[order[t] * 3 + 2];
+	}
+}
+
+void BVH::refit(const std::vector<glm::vec4>& triangles, const std::vector<unsigned int>& order, std::vector<Node>& nodes, std::vector<glm::vec4>& ordered) {
+	for (unsigned int t = 0; t < order.size(); ++t) {
+		ordered[t * 3 + 0] = triangles[order[t] * 3 + 0];
+		ordered[t * 3 + 1] = triangles[order[t] * 3 + 1];
+		ordered[t * 3 + 2] = triangles[order[t] * 3 + 2];
+	}
+
+	//Children are always stored after their parent so a reverse sweep refits bottom-up
+	for (int i = nodes.size() - 1; i >= 0; --i) {
+		Node& node = nodes[i];
+		Bounds b;
+		if (node.max.w > 0) {
+			unsigned int first = node.min.w;
+			for (unsigned int t = first; t < first + (unsigned int)node.max.w; ++t)
+				b.grow(triangleBounds(ordered, t));
+		}
+		else {
+			const Node& left = nodes[i + 1];
+			const Node& right = nodes[(int)node.min.w];
+			b.grow(glm::vec3(left.min));
+			b.grow(glm::vec3(left.max));
+			b.grow(glm::vec3(right.min));
+			b.grow(glm::vec3(right.max));
+		}
+		node.min = glm::vec4(b.min, node.min.w);
+		node.max = glm::vec4(b.max, node.max.w);
+	}
+}
@@ -9,6 +9,8 @@ float pitch;
 float speed;
 bool w, a, s, d, c;
 bool mouseRel;
+bool turned;
+bool moving;
 
 bool Camera::init(INIReader config) {
 
@@ -30,6 +32,8 @@ bool Camera::init(INIReader config) {
 	c = false;
 
 	mouseRel = false;
+	turned = false;
+	moving = false;
 
 	front.x = cos(glm::radians(pitch)) * cos(glm::radians(yaw));
 	front.y = sin(glm::radians(pitch));
@@ -85,6 +89,7 @@ void Camera::processSDLEvent(SDL_Event event) {
 		pitch -= event.motion.yrel * sensitivity;
 		if (pitch > 89.0f) pitch = 89.0f;
 		if (pitch < -89.0f) pitch = -89.0f;
+		turned = true;
 		front.x = cos(glm::radians(pitch)) * cos(glm::radians(yaw));
 		front.y = sin(glm::radians(pitch));
 		front.z = cos(glm::radians(pitch)) * sin(glm::radians(yaw));
@@ -102,6 +107,8 @@ void Camera::update(float deltaTime) {
 	if (s) position -= step * front;
 	if (a) position -= glm::normalize(glm::cross(front, up)) * step;
 	if (d) position += glm::normalize(glm::cross(front, up)) * step;
+	moving = turned || w || a || s || d;
+	turned = false;
 	if (c) {
 		if (mouseRel) {
 			SDL_SetRelativeMouseMode(SDL_FALSE);
@@ -119,6 +126,28 @@ glm::mat4 Camera::getViewMatrix() {
 	return glm::lookAt(position, position + front, up);
 }
 
+bool Camera::isMoving() {
+	return moving;
+}
+
 glm::vec3 Camera::getPosition() {
 	return position;
 }
+
+void Camera::getPose(glm::vec3& outPosition, float& outYaw, float& outPitch) {
+	outPosition = position;
+	outYaw = yaw;
+	outPitch = pitch;
+}
+
+void Camera::setPose(glm::vec3 newPosition, float newYaw, float newPitch) {
+	//Playback sets the pose every frame, only a different one counts as motion
+	turned = turned || newPosition != position || newYaw != yaw || newPitch != pitch;
+	position = newPosition;
+	yaw = newYaw;
+	pitch = newPitch;
+	front.x = cos(glm::radians(pitch)) * cos(glm::radians(yaw));
+	front.y = sin(glm::radians(pitch));
+	front.z = cos(glm::radians(pitch)) * sin(glm::radians(yaw));
+	front = glm::normalize(front);
+}
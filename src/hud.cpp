@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "hud.h"
+#include "profiler.h"
+#include "resources.h"
+
+#define HUD_MAX_QUADS 8192
+#define HUD_FRAME_HISTORY 128
+#define HUD_WIDTH 300
+#define HUD_MARGIN 8
+#define HUD_BAR_HEIGHT 10
+#define HUD_MS_WIDTH 10.f
+#define HUD_GRAPH_HEIGHT 60.f
+#define HUD_GRAPH_MS 50.f
+
+namespace {
+struct HUDVertex {
+	glm::vec2 position;
+	glm::vec4 color;
+};
+
+//Rows of three bits from the top, most significant bit on the left
+const char* glyphChars = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:/-%()";
+const unsigned short glyphs[] = {
+	0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7249, 0x7bef, 0x7bcf,
+	0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b, 0x5bed, 0x7497, 0x126a,
+	0x5bad, 0x4927, 0x5fed, 0x6b6d, 0x2b6a, 0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492,
+	0x5b6f, 0x5b6a, 0x5bfd, 0x5aad, 0x5a92, 0x72a7, 0x0002, 0x0410, 0x12a4, 0x01c0,
+	0x52a5, 0x2922, 0x224a
+};
+
+const glm::vec4 stageColors[] = {
+	glm::vec4(0.90f, 0.30f, 0.30f, 1), glm::vec4(0.30f, 0.70f, 0.90f, 1), glm::vec4(0.95f, 0.75f, 0.25f, 1),
+	glm::vec4(0.50f, 0.85f, 0.40f, 1), glm::vec4(0.75f, 0.45f, 0.90f, 1), glm::vec4(0.95f, 0.55f, 0.20f, 1),
+	glm::vec4(0.35f, 0.85f, 0.75f, 1), glm::vec4(0.90f, 0.45f, 0.70f, 1), glm::vec4(0.60f, 0.60f, 0.95f, 1),
+	glm::vec4(0.80f, 0.80f, 0.45f, 1), glm::vec4(0.55f, 0.75f, 0.55f, 1), glm::vec4(0.85f, 0.65f, 0.55f, 1)
+};
+
+unsigned int hudShader;
+unsigned int hudVAO;
+unsigned int hudVBO;
+unsigned int hudWidth;
+unsigned int hudHeight;
+int hudScale;
+std::vector<HUDVertex> hudVertices;
+float frameTimes[HUD_FRAME_HISTORY];
+unsigned int frameTimeIndex = 0;
+
+void quad(float x, float y, float w, float h, glm::vec4 color) {
+	if (hudVertices.size() + 6 > HUD_MAX_QUADS * 6 || w <= 0 || h <= 0)
+		return;
+	HUDVertex corners[4] = { { glm::vec2(x, y), color }, { glm::vec2(x + w, y), color }, { glm::vec2(x + w, y + h), color }, { glm::vec2(x, y + h), color } };
+	hudVertices.push_back(corners[0]);
+	hudVertices.push_back(corners[1]);
+	hudVertices.push_back(corners[2]);
+	hudVertices.push_back(corners[0]);
+	hudVertices.push_back(corners[2]);
+	hudVertices.push_back(corners[3]);
+}
+
+//Returns the x after the text so labels can be chained
+float text(float x, float y, const std::string& str, glm::vec4 color) {
+	for (char c : str) {
+		const char* found = strchr(glyphChars, toupper(c));
+		if (c != ' ' && found != NULL && *found != '\0') {
+			//Runs of lit cells in a row become one quad
+			unsigned short glyph = glyphs[found - glyphChars];
+			for (int row = 0; row < 5; ++row) {
+				int bits = (glyph >> ((4 - row) * 3)) & 7;
+				for (int col = 0; col < 3; ++col) {
+					if (!(bits & (4 >> col)))
+						continue;
+					int run = col;
+					while (run + 1 < 3 && (bits & (4 >> (run + 1))))
+						run++;
+					quad(x + col * hudScale, y + row * hudScale, (run - col + 1) * hudScale, hudScale, color);
+					col = run;
+				}
+			}
+		}
+		x += 4 * hudScale;
+	}
+	return x;
+}
+
+std::string format(const char* fmt, double value) {
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), fmt, value);
+	return buffer;
+}
+}
+
+bool HUD::init(INIReader config, unsigned int shader, unsigned int width, unsigned int height) {
+	hudShader = shader;
+	hudWidth = width;
+	hudHeight = height;
+	hudScale = std::max((int)config.GetInteger("hud", "scale", 2), 1);
+	hudVertices.reserve(HUD_MAX_QUADS * 6);
+	std::fill(frameTimes, frameTimes + HUD_FRAME_HISTORY, 0.f);
+
+	glGenVertexArrays(1, &hudVAO);
+	glGenBuffers(1, &hudVBO);
+	glBindVertexArray(hudVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, hudVBO);
+	Resources::addBuffer("HUD", "hudVBO", "GL buffer", HUD_MAX_QUADS * 6 * sizeof(HUDVertex));
+	glBufferData(GL_ARRAY_BUFFER, HUD_MAX_QUADS * 6 * sizeof(HUDVertex), NULL, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(HUDVertex), (void*)offsetof(HUDVertex, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(HUDVertex), (void*)offsetof(HUDVertex, color));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+void HUD::addFrameTime(float ms) {
+	frameTimes[frameTimeIndex] = ms;
+	frameTimeIndex = (frameTimeIndex + 1) % HUD_FRAME_HISTORY;
+}
+
+//Stage times are from the newest frame the profiler has read back, a few frames behind the one on screen
+void HUD::draw(const std::vector<unsigned int>& stages, unsigned int noOfVPLs, unsigned int noOfInvalidVPLs, double rays) {
+	const glm::vec4 white(1, 1, 1, 1);
+	const glm::vec4 grey(0.6f, 0.6f, 0.6f, 1);
+	const float lineHeight = 7 * hudScale;
+	hudVertices.clear();
+
+	float x = HUD_MARGIN * 2;
+	float y = HUD_MARGIN * 2;
+	hudVertices.resize(6);
+
+	//Frame time graph, the line marks 60 Hz
+	float latest = frameTimes[(frameTimeIndex + HUD_FRAME_HISTORY - 1) % HUD_FRAME_HISTORY];
+	text(x, y, "FRAME " + format("%.2f", latest) + " MS", white);
+	y += lineHeight;
+	float barWidth = (HUD_WIDTH - HUD_MARGIN * 2) / (float)HUD_FRAME_HISTORY;
+	for (unsigned int i = 0; i < HUD_FRAME_HISTORY; ++i) {
+		float ms = frameTimes[(frameTimeIndex + i) % HUD_FRAME_HISTORY];
+		float h = std::min(ms / HUD_GRAPH_MS, 1.f) * HUD_GRAPH_HEIGHT;
+		glm::vec4 color = ms < 16.7f ? glm::vec4(0.3f, 0.8f, 0.3f, 1) : ms < 33.4f ? glm::vec4(0.9f, 0.8f, 0.2f, 1) : glm::vec4(0.9f, 0.3f, 0.3f, 1);
+		quad(x + i * barWidth, y + HUD_GRAPH_HEIGHT - h, barWidth, h, color);
+	}
+	quad(x, y + HUD_GRAPH_HEIGHT - (16.7f / HUD_GRAPH_MS) * HUD_GRAPH_HEIGHT, HUD_WIDTH - HUD_MARGIN * 2, 1, white);
+	y += HUD_GRAPH_HEIGHT + hudScale * 2;
+
+	//Stacked bars, one per clock domain, scaled to HUD_MS_WIDTH pixels per millisecond
+	const char* labels[2] = { "GPU", "CPU" };
+	for (int gpu = 1; gpu >= 0; --gpu) {
+		float total = 0;
+		float bx = x + 4 * 4 * hudScale;
+		for (unsigned int s = 0; s < stages.size(); ++s) {
+			float ms = Profiler::getLatest(stages[s]);
+			if (ms < 0 || Profiler::isLatestGPU(stages[s]) != (bool)gpu)
+				continue;
+			float w = std::min(ms * HUD_MS_WIDTH, x + HUD_WIDTH - HUD_MARGIN * 2 - bx);
+			quad(bx, y, w, HUD_BAR_HEIGHT, stageColors[s % (sizeof(stageColors) / sizeof(stageColors[0]))]);
+			bx += std::max(w, 0.f);
+			total += ms;
+		}
+		text(x, y + (HUD_BAR_HEIGHT - 5 * hudScale) / 2, labels[1 - gpu], white);
+		text(bx + hudScale * 2, y + (HUD_BAR_HEIGHT - 5 * hudScale) / 2, format("%.2f", total), grey);
+		y += HUD_BAR_HEIGHT + hudScale * 2;
+	}
+
+	//Legend
+	for (unsigned int s = 0; s < stages.size(); ++s) {
+		float ms = Profiler::getLatest(stages[s]);
+		if (ms < 0)
+			continue;
+		quad(x, y, 5 * hudScale, 5 * hudScale, stageColors[s % (sizeof(stageColors) / sizeof(stageColors[0]))]);
+		float tx = text(x + 7 * hudScale, y, Profiler::getName(stages[s]), white);
+		text(std::max(tx + hudScale * 2, x + HUD_WIDTH - HUD_MARGIN * 2 - 6 * 4 * hudScale), y, format("%.2f", ms), grey);
+		y += lineHeight;
+	}
+	y += hudScale * 2;
+
+	//VPLs, valid in green
+	unsigned int noOfValid = noOfVPLs - std::min(noOfInvalidVPLs, noOfVPLs);
+	text(x, y, "VPLS " + std::to_string(noOfValid) + "/" + std::to_string(noOfVPLs) + " VALID", white);
+	y += lineHeight;
+	float validWidth = noOfVPLs > 0 ? (HUD_WIDTH - HUD_MARGIN * 2) * noOfValid / (float)noOfVPLs : 0;
+	quad(x, y, validWidth, HUD_BAR_HEIGHT / 2, glm::vec4(0.3f, 0.8f, 0.3f, 1));
+	quad(x + validWidth, y, HUD_WIDTH - HUD_MARGIN * 2 - validWidth, HUD_BAR_HEIGHT / 2, glm::vec4(0.9f, 0.3f, 0.3f, 1));
+	y += HUD_BAR_HEIGHT / 2 + hudScale * 2;
+
+	text(x, y, "RAYS " + format("%.3f", rays / 1000000.0) + " M", white);
+	y += lineHeight;
+
+	double total = Resources::getTotal() / (1024.0 * 1024.0);
+	double budget = Resources::getBudget() / (1024.0 * 1024.0);
+	text(x, y, "MEM " + format("%.0f", total) + "/" + format("%.0f", budget) + " MB", white);
+	y += lineHeight;
+	if (budget > 0) {
+		float usedWidth = std::min(total / budget, 1.0) * (HUD_WIDTH - HUD_MARGIN * 2);
+		quad(x, y, usedWidth, HUD_BAR_HEIGHT / 2, glm::vec4(0.3f, 0.7f, 0.9f, 1));
+		quad(x + usedWidth, y, HUD_WIDTH - HUD_MARGIN * 2 - usedWidth, HUD_BAR_HEIGHT / 2, glm::vec4(0.3f, 0.3f, 0.3f, 1));
+		y += HUD_BAR_HEIGHT / 2 + hudScale * 2;
+	}
+
+	//The background quad was reserved first so it is drawn underneath everything else
+	glm::vec4 backgroundColor(0, 0, 0, 0.6f);
+	float h = y - HUD_MARGIN / 2;
+	glm::vec2 corners[4] = { glm::vec2(HUD_MARGIN, HUD_MARGIN), glm::vec2(HUD_MARGIN + HUD_WIDTH, HUD_MARGIN), glm::vec2(HUD_MARGIN + HUD_WIDTH, HUD_MARGIN + h), glm::vec2(HUD_MARGIN, HUD_MARGIN + h) };
+	int order[6] = { 0, 1, 2, 0, 2, 3 };
+	for (int i = 0; i < 6; ++i)
+		hudVertices[i] = { corners[order[i]], backgroundColor };
+
+	glViewport(0, 0, hudWidth, hudHeight);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glUseProgram(hudShader);
+	glUniform2f(glGetUniformLocation(hudShader, "screenSize"), hudWidth, hudHeight);
+	glBindVertexArray(hudVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, hudVBO);
+	//Orphaning hands the driver fresh storage, so the upload never waits for last frame's draw
+	glBufferData(GL_ARRAY_BUFFER, HUD_MAX_QUADS * 6 * sizeof(HUDVertex), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, hudVertices.size() * sizeof(HUDVertex), hudVertices.data());
+	glDrawArrays(GL_TRIANGLES, 0, hudVertices.size());
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDisable(GL_BLEND);
+}
+
+void HUD::destroy() {
+	glDeleteBuffers(1, &hudVBO);
+	glDeleteVertexArrays(1, &hudVAO);
+}
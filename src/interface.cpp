@@ -7,6 +7,9 @@
 #include "interface.h"
 #include "camera.h"
 #include "model.h"
+#include "profiler.h"
+#include "benchmark.h"
+#include "recorder.h"
 
 SDL_Window* window;
 SDL_GLContext glcontext;
@@ -16,6 +19,7 @@ float deltaTime;
 float lastFrame;
 float maxTime = 0;
 bool interactive;
+bool hidden;
 
 bool interface::init(INIReader config) {
 	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
@@ -27,8 +31,9 @@ bool interface::init(INIReader config) {
 	height = config.GetInteger("interface", "height", 320);
 	maxTime = config.GetReal("interface", "time", 0);
 	interactive = config.GetBoolean("interface", "interactive", true);
+	hidden = config.GetBoolean("benchmark", "enabled", false) && config.GetBoolean("benchmark", "hidden", true);
 
-	window = SDL_CreateWindow("Protogee", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_OPENGL);
+	window = SDL_CreateWindow("Protogee", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_OPENGL | (hidden ? SDL_WINDOW_HIDDEN : 0));
 	if (window == NULL) {
 		std::cerr << "Failed to create Window: %s" << SDL_GetError() << std::endl;
 		return false;
@@ -62,9 +67,12 @@ bool interface::init(INIReader config) {
 
 void interface::loop() {
 	bool online = true;
+	bool benchmark = Benchmark::isEnabled();
+	unsigned int frame = 0;
 	SDL_Event event;
 	while (online) {
-		if (interactive) {
+		Profiler::beginFrame();
+		if (interactive && !benchmark) {
 			while (SDL_PollEvent(&event)) {
 				switch (event.type) {
 				case SDL_QUIT:
@@ -73,16 +81,33 @@ void interface::loop() {
 				}
 				Camera::processSDLEvent(event);
 				renderer::processSDLEvent(event);
+				Recorder::processSDLEvent(event);
 			}
 		}
+		else {
+			SDL_PumpEvents();
+		}
 		float currentFrame = SDL_GetTicks();
 		deltaTime = (currentFrame - lastFrame) / 1000.0f;
 		lastFrame = currentFrame;
+		//Benchmarks run on simulated time so results do not depend on how fast frames come back
+		if (benchmark)
+			deltaTime = Benchmark::apply(frame);
+		float modelTime = Model::getTime();
 		Camera::update(deltaTime);
 		Model::update(deltaTime);
 		renderer::update(deltaTime);
+		if (!benchmark)
+			Recorder::capture(deltaTime, modelTime);
+		else
+			Benchmark::capture(frame);
 		SDL_GL_SwapWindow(window);
+		frame++;
 
+		if (benchmark) {
+			online = Benchmark::advance(frame);
+			continue;
+		}
 		if (maxTime != 0 && currentFrame > maxTime) {/*
 			unsigned int *screenPixels = new unsigned int[width * height];
 			glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_INT, screenPixels);
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "ism.h"
+
+#define ISM_SEED 1337
+
+void ISM::sample(const std::vector<glm::vec4>& triangles, unsigned int noOfSamples, std::vector<Sample>& samples) {
+	unsigned int noOfTriangles = triangles.size() / 3;
+	samples.clear();
+	if (noOfTriangles == 0)
+		return;
+
+	//Area-weighted so every subset of the samples covers the scene evenly
+	std::vector<float> areas(noOfTriangles);
+	float total = 0;
+	for (unsigned int t = 0; t < noOfTriangles; ++t) {
+		glm::vec3 a = glm::vec3(triangles[t * 3 + 0]);
+		glm::vec3 b = glm::vec3(triangles[t * 3 + 1]);
+		glm::vec3 c = glm::vec3(triangles[t * 3 + 2]);
+		total += glm::length(glm::cross(b - a, c - a)) * 0.5f;
+		areas[t] = total;
+	}
+
+	std::mt19937 generator(ISM_SEED);
+	std::uniform_real_distribution<float> distribution(0.f, 1.f);
+	samples.resize(noOfSamples);
+	for (unsigned int i = 0; i < noOfSamples; ++i) {
+		float r = distribution(generator) * total;
+		unsigned int t = std::min((unsigned int)(std::lower_bound(areas.begin(), areas.end(), r) - areas.begin()), noOfTriangles - 1);
+		float u = distribution(generator);
+		float v = distribution(generator);
+		if (u + v > 1) {
+			u = 1 - u;
+			v = 1 - v;
+		}
+		samples[i] = { t, u, v };
+	}
+}
+
+void ISM::place(const std::vector<glm::vec4>& triangles, const std::vector<Sample>& samples, std::vector<glm::vec4>& points) {
+	points.resize(samples.size());
+	for (unsigned int i = 0; i < samples.size(); ++i) {
+		const Sample& s = samples[i];
+		glm::vec4 a = triangles[s.triangle * 3 + 0];
+		glm::vec4 b = triangles[s.triangle * 3 + 1];
+		glm::vec4 c = triangles[s.triangle * 3 + 2];
+		points[i] = a + s.u * (b - a) + s.v * (c - a);
+	}
+}
+
+unsigned int ISM::getTilesPerRow(unsigned int noOfMaps) {
+	return std::max((unsigned int)std::ceil(std::sqrt((float)noOfMaps)), 1u);
+}
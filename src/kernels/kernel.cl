@@ -20,8 +20,18 @@ typedef struct{
   float4 normal;
 } light;
 
+typedef struct{
+  float4 position;
+  float4 diffuse;
+  float4 min;
+  float4 max;
+  float4 link;
+} light_node;
+
 const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
 
+#define TILE_SAMPLES 5
+
 __kernel void init_masks(const write_only image2d_array_t vpl_masks){
 	const uint x = get_global_id(0);
 	const uint y = get_global_id(1);
@@ -29,27 +39,348 @@ __kernel void init_masks(const write_only image2d_array_t vpl_masks){
 	write_imagef(vpl_masks, (int4)(x, y, v, 0), (float4)(0));
 }
 
-__kernel void pre_rays(read_only image2d_t positions, constant light* vpls, const uint vplsPerPixel, const float realVPP, const uint pwidth, const uint iwidth, const uint iss, const uint ihi, const uint ihs, global ray* rays){
+float lightcut_bound(global const light_node* node, const float3 pos){
+	const float3 d = max(max(node->min.xyz - pos, pos - node->max.xyz), (float3)(0));
+	return max(node->diffuse.x, max(node->diffuse.y, node->diffuse.z)) / (1 + dot(d, d));
+}
+
+//A leaf is traced only if its representative ends up in the per-pixel cut, the walk and its limits mirror lightcut() in iplane.fsh
+#define LIGHT_TREE_STACK_SIZE 64
+bool lightcut_traced(global const light_node* tree, const uint leaf, const uint root, const float3 pos, const float error, const uint maxCut){
+	const float3 rd = tree[root].position.xyz - pos;
+	const float total = max(tree[root].diffuse.x, max(tree[root].diffuse.y, tree[root].diffuse.z)) / (1 + dot(rd, rd));
+	const float rep = tree[leaf].diffuse.w;
+	int stack[LIGHT_TREE_STACK_SIZE];
+	int top = 0;
+	uint cut = 0;
+	stack[top++] = root;
+	while(top > 0){
+		const int node = stack[--top];
+		const int left = (int)tree[node].min.w;
+		if(left >= 0 && cut + top + 2 <= maxCut && top + 2 <= LIGHT_TREE_STACK_SIZE && lightcut_bound(&tree[node], pos) > error * total){
+			stack[top++] = left;
+			stack[top++] = (int)tree[node].max.w;
+		}
+		else{
+			if(tree[node].diffuse.w == rep)
+				return true;
+			cut++;
+		}
+	}
+	return false;
+}
+
+//Pairs behind the receiver or too dim are never traced, only terms iplane.fsh evaluates count, so a zero threshold never changes the image.
+//Path length attenuation is bounded by the direct distance alone, a pair is only dropped if it stays under the threshold when shaded
+bool vpl_culled(global const light* vpl, const float3 pos, const float3 normal, const float threshold){
+	const float3 d = vpl->position.xyz - pos;
+	const float dist2 = dot(d, d);
+	if(dot(normal, normal) == 0 || dist2 == 0)
+		return true;
+	const float3 l = d * rsqrt(dist2);
+	const float receiver = dot(normalize(normal), l);
+	if(receiver <= 0)
+		return true;
+	const float power = max(vpl->diffuse.x, max(vpl->diffuse.y, vpl->diffuse.z));
+	return power * receiver / (M_PI_F * (1 + dist2)) < threshold;
+}
+
+__kernel void tile_discontinuity(read_only image2d_t positions, read_only image2d_t normals, const uint pwidth, const uint iwidth, const uint iheight, const uint tileSize, const float4 viewPos, const float depthThreshold, const float normalThreshold, global int* tileDisc){
+	const uint tx = get_global_id(0);
+	const uint ty = get_global_id(1);
+	const uint cx = min(tx * tileSize + tileSize / 2, iwidth - 1);
+	const uint cy = min(ty * tileSize + tileSize / 2, iheight - 1);
+	const float3 cnormal = normalize(read_imagef(normals, sampler, (int2)(cx, cy) * (pwidth / (float)iwidth)).xyz);
+	float minDepth = MAXFLOAT;
+	float maxDepth = 0;
+	int disc = 0;
+	for(uint y = ty * tileSize; y < min((ty + 1) * tileSize, iheight) && !disc; ++y){
+		for(uint x = tx * tileSize; x < min((tx + 1) * tileSize, iwidth); ++x){
+			const int2 coords = (int2)(x, y) * (pwidth / (float)iwidth);
+			const float depth = distance(read_imagef(positions, sampler, coords).xyz, viewPos.xyz);
+			minDepth = min(minDepth, depth);
+			maxDepth = max(maxDepth, depth);
+			if(dot(normalize(read_imagef(normals, sampler, coords).xyz), cnormal) < normalThreshold)
+				disc = 1;
+		}
+	}
+	if(maxDepth - minDepth > depthThreshold * minDepth)
+		disc = 1;
+	tileDisc[ty * get_global_size(0) + tx] = disc;
+}
+
+//One ray per slice VPL to each tile corner and the tile centre
+__kernel void tile_rays(read_only image2d_t positions, global const light* vpls, const uint vplsPerPixel, const uint pwidth, const uint iwidth, const uint iheight, const uint iss, const uint ihi, const uint ihs, const uint tileSize, global ray* tileRays){
+	const uint tx = get_global_id(0);
+	const uint ty = get_global_id(1);
+	const uint s = get_global_id(2);
+	const uint cell = s / vplsPerPixel;
+	const float3 vpos = vpls[ihs * s + ihi].position.xyz;
+	const uint x0 = tx * tileSize;
+	const uint y0 = ty * tileSize;
+	const uint x1 = min(x0 + tileSize - 1, iwidth - 1);
+	const uint y1 = min(y0 + tileSize - 1, iheight - 1);
+	const uint2 samples[TILE_SAMPLES] = { (uint2)(x0, y0), (uint2)(x1, y0), (uint2)(x0, y1), (uint2)(x1, y1), (uint2)((x0 + x1) / 2, (y0 + y1) / 2) };
+	for(uint k = 0; k < TILE_SAMPLES; ++k){
+		//Snap each sample onto a pixel that uses this VPL under interleaved sampling
+		const uint sx = min((samples[k].x / iss) * iss + (cell % iss), iwidth - 1);
+		const uint sy = min((samples[k].y / iss) * iss + (cell / iss), iheight - 1);
+		const float3 pos = read_imagef(positions, sampler, (int2)(sx, sy) * (pwidth / (float)iwidth)).xyz;
+		const int i = (((ty * get_global_size(0) + tx) * get_global_size(2)) + s) * TILE_SAMPLES + k;
+		tileRays[i].o = (float4) (vpos, length(pos - vpos) - 0.1);
+		tileRays[i].d = (float4) (normalize(pos - vpos), 0.f);
+		tileRays[i].extra.x = 0xFFFFFFFF;
+		tileRays[i].extra.y = 0xFFFFFFFF;
+	}
+}
+
+//Whether the segment from o along d up to tmax touches the box, an empty box (min > max) touches nothing
+bool segment_box(const float3 o, const float3 d, const float tmax, const float3 bmin, const float3 bmax){
+	if(bmin.x > bmax.x)
+		return false;
+	const float3 invd = 1 / d;
+	const float3 t0 = (bmin - o) * invd;
+	const float3 t1 = (bmax - o) * invd;
+	const float3 tn = fmin(t0, t1);
+	const float3 tf = fmax(t0, t1);
+	return fmax(fmax(tn.x, tn.y), fmax(tn.z, 0.f)) <= fmin(fmin(tf.x, tf.y), fmin(tf.z, tmax));
+}
+
+//A mask from when this slice was last traced still holds if the surface point reprojects onto a pixel of the same interleaved cell
+//that saw the same point, its VPL has not changed since and no dynamic mesh moved across the ray
+bool mask_cached(const float3 pos, const float3 vpos, const uint x, const uint y, const uint v, const uint vplsPerPixel, const uint iwidth, const uint iheight, const uint iss, const uint ihi,
+	const float16 prevViewProj, global const float4* cachePos, const float threshold, const uint vplStamp, const uint sliceFrame, const float4 boundsMin, const float4 boundsMax, uint* cached){
+	if(vplStamp > sliceFrame)
+		return false;
+	const float4 clip = prevViewProj.s0123 * pos.x + prevViewProj.s4567 * pos.y + prevViewProj.s89ab * pos.z + prevViewProj.scdef;
+	if(clip.w <= 0)
+		return false;
+	const float2 uv = (clip.xy / clip.w) * 0.5f + 0.5f;
+	const int qx = (int)round((uv.x * iwidth - 0.5f - (x % iss)) / iss) * (int)iss + (int)(x % iss);
+	const int qy = (int)round((uv.y * iheight - 0.5f - (y % iss)) / iss) * (int)iss + (int)(y % iss);
+	if(qx < 0 || qy < 0 || qx >= (int)iwidth || qy >= (int)iheight)
+		return false;
+	const float4 prev = cachePos[(ihi * iheight + qy) * iwidth + qx];
+	if(prev.w == 0 || distance(prev.xyz, pos) > threshold)
+		return false;
+	if(segment_box(vpos, normalize(pos - vpos), length(pos - vpos), boundsMin.xyz, boundsMax.xyz))
+		return false;
+	*cached = ((ihi * iheight + qy) * iwidth + qx) * vplsPerPixel + v;
+	return true;
+}
+
+__kernel void pre_rays(read_only image2d_t positions, read_only image2d_t normals, global const light* vpls, const uint vplsPerPixel, const float realVPP, const uint pwidth, const uint iwidth, const uint iss, const uint ihi, const uint ihs, global ray* rays, global const light_node* lightTree, const uint lightTreeSize, const uint lightTreeRoot, const float lightcutError, const uint lightcutMaxCut, const uint lightcutEnabled, const float cullThreshold, const uint cullingEnabled, const uint statsEnabled, global int* counters, const uint adaptiveEnabled, const uint tileSize, const uint tilesX, global const int* tileOcclus, global const int* tileDisc,
+	const uint cacheEnabled, const uint iheight, global const uchar2* cacheIn, global const float4* cachePosIn, global float4* cachePosOut, const float16 prevViewProj, const float cacheThreshold, global const uint* vplStamps, const uint sliceFrame, const float4 boundsMin, const float4 boundsMax){
 	const uint x = get_global_id(0) / realVPP;
 	const uint y = get_global_id(1) / realVPP;
 	const uint v = get_global_id(2);
-	const uint pv = ihs * (vplsPerPixel * (((y % iss) * iss) + (x % iss)) + v) + ihi;
+	const uint cell = ((y % iss) * iss) + (x % iss);
+	const uint pv = ihs * (vplsPerPixel * cell + v) + ihi;
 	const int i = ((y*iwidth + x) * vplsPerPixel) + v;
-	const float3 pos = read_imagef(positions, sampler, (int2)(x, y) * (pwidth / (float)iwidth)).xyz;
+	const int2 coords = (int2)(x, y) * (pwidth / (float)iwidth);
+	const float3 pos = read_imagef(positions, sampler, coords).xyz;
 	const float3 vpos = vpls[pv].position.xyz;
 	rays[i].o = (float4) (vpos, length(pos - vpos) - 0.1);
 	rays[i].d = (float4) (normalize(pos - vpos), 0.f);
 	rays[i].extra.x = 0xFFFFFFFF;
 	rays[i].extra.y = 0xFFFFFFFF;
+	rays[i].padding.x = 0;
+	rays[i].padding.y = 0;
+	uint cached;
+	if(cacheEnabled && v == 0)
+		cachePosOut[(ihi * iheight + y) * iwidth + x] = (float4)(pos, 1);
+	if(cacheEnabled && mask_cached(pos, vpos, x, y, v, vplsPerPixel, iwidth, iheight, iss, ihi, prevViewProj, cachePosIn, cacheThreshold, vplStamps[pv], sliceFrame, boundsMin, boundsMax, &cached)){
+		rays[i].extra.y = 0;
+		rays[i].padding.x = cacheIn[cached].x;
+		rays[i].padding.y = cacheIn[cached].y;
+	}
+	else if(lightcutEnabled && !lightcut_traced(lightTree + cell * lightTreeSize, v, lightTreeRoot, pos, lightcutError, lightcutMaxCut))
+		rays[i].extra.y = 0;
+	else if(cullingEnabled && vpl_culled(&vpls[pv], pos, read_imagef(normals, sampler, coords).xyz, cullThreshold))
+		rays[i].extra.y = 0;
+	else if(adaptiveEnabled){
+		//Pixels inherit the tile result unless the tile samples disagree or the tile has a discontinuity
+		const uint tile = (y / tileSize) * tilesX + (x / tileSize);
+		global const int* samples = tileOcclus + ((tile * iss * iss * vplsPerPixel) + (cell * vplsPerPixel) + v) * TILE_SAMPLES;
+		int visible = 0;
+		for(uint k = 0; k < TILE_SAMPLES; ++k)
+			visible += samples[k] == -1;
+		if(tileDisc[tile] || (visible != 0 && visible != TILE_SAMPLES))
+			rays[i].padding.y = 1;
+		else{
+			rays[i].extra.y = 0;
+			rays[i].padding.x = visible ? 1 : 0;
+		}
+	}
+	if(statsEnabled && rays[i].extra.y != 0)
+		atomic_inc(&counters[0]);
 }
-__kernel void post_rays(constant ray* rays, constant int* occlus, const uint vplsPerPixel, const float realVPP, const uint pwidth, const uint iwidth, const uint iss, const uint ihi, const uint ihs, constant light* vpls, const write_only image2d_array_t vpl_masks){
+__kernel void post_rays(constant ray* rays, constant int* occlus, const uint vplsPerPixel, const float realVPP, const uint pwidth, const uint iwidth, const uint iss, const uint ihi, const uint ihs, global const light* vpls, const write_only image2d_array_t vpl_masks, const uint statsEnabled, global int* counters,
+	const uint cacheEnabled, const uint iheight, global uchar2* cacheOut){
 	const uint x = get_global_id(0) / realVPP;
 	const uint y = get_global_id(1) / realVPP;
 	const uint v = get_global_id(2);
 	const uint pv = ihs * (vplsPerPixel * (((y % iss) * iss) + (x % iss)) + v) + ihi;
 	const int i = ((y*iwidth + x) * vplsPerPixel) + v;
-	if(occlus[i] == -1)
-		write_imagef(vpl_masks, (int4)(x, y, pv, 0), (float4)(1));
-	else
-		write_imagef(vpl_masks, (int4)(x, y, pv, 0), (float4)(0));
+	const float refined = rays[i].padding.y;
+	float visible;
+	if(rays[i].extra.y == 0)
+		visible = rays[i].padding.x;
+	else if(occlus[i] == -1)
+		visible = 1;
+	else{
+		visible = 0;
+		if(statsEnabled)
+			atomic_inc(&counters[1]);
+	}
+	write_imagef(vpl_masks, (int4)(x, y, pv, 0), (float4)(visible, refined, 0, 0));
+	if(cacheEnabled)
+		cacheOut[((ihi * iheight + y) * iwidth + x) * vplsPerPixel + v] = (uchar2)((uchar)visible, (uchar)refined);
+}
+
+#define PACKET_SIZE 64
+//BVH_MAX_DEPTH in bvh.cpp keeps the traversal within this, the bounds check below only guards against a mismatch
+#define PACKET_STACK_SIZE 128
+
+typedef struct{
+  float4 min;
+  float4 max;
+} bvh_node;
+
+bool ray_box(const float3 o, const float3 invd, const float tmax, const float3 bmin, const float3 bmax){
+	const float3 t0 = (bmin - o) * invd;
+	const float3 t1 = (bmax - o) * invd;
+	const float3 tn = fmin(t0, t1);
+	const float3 tf = fmax(t0, t1);
+	const float enter = fmax(fmax(tn.x, tn.y), fmax(tn.z, 0.f));
+	const float exit = fmin(fmin(tf.x, tf.y), fmin(tf.z, tmax));
+	return enter <= exit;
+}
+
+bool ray_triangle(const float3 o, const float3 d, const float tmax, const float3 v0, const float3 v1, const float3 v2){
+	const float3 e1 = v1 - v0;
+	const float3 e2 = v2 - v0;
+	const float3 p = cross(d, e2);
+	const float det = dot(e1, p);
+	if(fabs(det) < 1e-8f)
+		return false;
+	const float inv = 1 / det;
+	const float3 s = o - v0;
+	const float u = dot(s, p) * inv;
+	if(u < 0 || u > 1)
+		return false;
+	const float3 q = cross(s, e1);
+	const float w = dot(d, q) * inv;
+	if(w < 0 || u + w > 1)
+		return false;
+	const float t = dot(e2, q) * inv;
+	return t > 0 && t < tmax;
+}
+
+//Each work group is an 8x8 packet of receivers sharing one VPL as ray origin.
+//The packet walks the BVH together, culling nodes outside the box spanned by the origin and its receivers,
+//and every lane stops testing as soon as its own ray is occluded.
+__kernel void shared_origin_occlusion(read_only image2d_t positions, read_only image2d_t normals, global const light* vpls, const uint vplsPerPixel, const uint pwidth, const uint iwidth, const uint iheight, const uint iss, const uint ihi, const uint ihs, global const bvh_node* nodes, global const float4* triangles, global const light_node* lightTree, const uint lightTreeSize, const uint lightTreeRoot, const float lightcutError, const uint lightcutMaxCut, const uint lightcutEnabled, const float cullThreshold, const uint cullingEnabled, const uint statsEnabled, global int* counters, write_only image2d_array_t vpl_masks){
+	local int stack[PACKET_STACK_SIZE];
+	local int stackSize;
+	local int packetActive;
+	local int packetHit;
+	local float3 receiverMin[PACKET_SIZE];
+	local float3 receiverMax[PACKET_SIZE];
+
+	const uint cell = get_global_id(2) / vplsPerPixel;
+	const uint v = get_global_id(2) % vplsPerPixel;
+	const uint x = get_global_id(0) * iss + (cell % iss);
+	const uint y = get_global_id(1) * iss + (cell / iss);
+	const uint pv = ihs * (vplsPerPixel * cell + v) + ihi;
+	const uint lane = get_local_id(1) * get_local_size(0) + get_local_id(0);
+	const bool inside = x < iwidth && y < iheight;
+
+	const int2 coords = (int2)(x, y) * (pwidth / (float)iwidth);
+	const float3 pos = read_imagef(positions, sampler, coords).xyz;
+	const float3 o = vpls[pv].position.xyz;
+	const float tmax = length(pos - o) - 0.1f;
+	const float3 d = normalize(pos - o);
+	const float3 invd = 1 / d;
+
+	bool active = inside && tmax > 0;
+	float immediate = 1;
+	if(active && lightcutEnabled && !lightcut_traced(lightTree + cell * lightTreeSize, v, lightTreeRoot, pos, lightcutError, lightcutMaxCut)){
+		active = false;
+		immediate = 0;
+	}
+	else if(active && cullingEnabled && vpl_culled(&vpls[pv], pos, read_imagef(normals, sampler, coords).xyz, cullThreshold)){
+		active = false;
+		immediate = 0;
+	}
+	bool hit = false;
+
+	receiverMin[lane] = active ? fmin(o, pos) : o;
+	receiverMax[lane] = active ? fmax(o, pos) : o;
+	if(lane == 0){
+		stackSize = 0;
+		packetActive = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if(active)
+		packetActive = 1;
+	if(lane == 0){
+		for(uint l = 1; l < get_local_size(0) * get_local_size(1); ++l){
+			receiverMin[0] = fmin(receiverMin[0], receiverMin[l]);
+			receiverMax[0] = fmax(receiverMax[0], receiverMax[l]);
+		}
+		stack[0] = 0;
+		stackSize = 1;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	const float3 frustumMin = receiverMin[0];
+	const float3 frustumMax = receiverMax[0];
+
+	while(true){
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if(stackSize == 0 || packetActive == 0)
+			break;
+		const int n = stack[stackSize - 1];
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if(lane == 0){
+			stackSize--;
+			packetHit = 0;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		const bvh_node node = nodes[n];
+		const bool leaf = node.max.w > 0;
+		const bool inFrustum = all(node.min.xyz <= frustumMax) && all(node.max.xyz >= frustumMin);
+		if(inFrustum && active && !hit){
+			if(leaf){
+				const int first = (int)node.min.w;
+				const int count = (int)node.max.w;
+				for(int t = first; t < first + count && !hit; ++t)
+					hit = ray_triangle(o, d, tmax, triangles[t * 3 + 0].xyz, triangles[t * 3 + 1].xyz, triangles[t * 3 + 2].xyz);
+			}
+			else if(ray_box(o, invd, tmax, node.min.xyz, node.max.xyz))
+				packetHit = 1;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if(lane == 0){
+			if(packetHit && !leaf && stackSize + 2 <= PACKET_STACK_SIZE){
+				stack[stackSize++] = (int)node.min.w;
+				stack[stackSize++] = n + 1;
+			}
+			packetActive = 0;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if(active && !hit)
+			packetActive = 1;
+	}
+
+	if(inside){
+		write_imagef(vpl_masks, (int4)(x, y, pv, 0), (float4)(active ? (hit ? 0 : 1) : immediate));
+		if(statsEnabled && active){
+			atomic_inc(&counters[0]);
+			if(hit)
+				atomic_inc(&counters[1]);
+		}
+	}
 }
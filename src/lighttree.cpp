@@ -0,0 +1,108 @@
+#include <algorithm>
+
+#include "lighttree.h"
+
+namespace {
+float getPower(glm::vec4 diffuse) {
+	return glm::max(diffuse.r, glm::max(diffuse.g, diffuse.b));
+}
+
+int buildRange(const std::vector<Light>& vpls, const std::vector<unsigned int>& indices, float normalWeight, std::vector<unsigned int>& order, unsigned int begin, unsigned int end, unsigned int& next, std::vector<LightTree::Node>& tree) {
+	if (end - begin == 1)
+		return order[begin];
+
+	glm::vec3 pmin = glm::vec3(vpls[indices[order[begin]]].position);
+	glm::vec3 pmax = pmin;
+	glm::vec3 nmin = glm::vec3(vpls[indices[order[begin]]].normal);
+	glm::vec3 nmax = nmin;
+	for (unsigned int i = begin + 1; i < end; ++i) {
+		const Light& vpl = vpls[indices[order[i]]];
+		pmin = glm::min(pmin, glm::vec3(vpl.position));
+		pmax = glm::max(pmax, glm::vec3(vpl.position));
+		nmin = glm::min(nmin, glm::vec3(vpl.normal));
+		nmax = glm::max(nmax, glm::vec3(vpl.normal));
+	}
+
+	//Normal extents are scaled to the positional extent so either can drive the split
+	glm::vec3 pextent = pmax - pmin;
+	glm::vec3 nextent = (nmax - nmin) * normalWeight * glm::max(glm::length(pextent), 1e-4f) * 0.5f;
+	int axis = 0;
+	float extent = pextent.x;
+	for (int a = 1; a < 6; ++a) {
+		float e = a < 3 ? pextent[a] : nextent[a - 3];
+		if (e > extent) {
+			extent = e;
+			axis = a;
+		}
+	}
+
+	unsigned int mid = (begin + end) / 2;
+	std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](unsigned int a, unsigned int b) {
+		const Light& la = vpls[indices[a]];
+		const Light& lb = vpls[indices[b]];
+		if (axis < 3)
+			return la.position[axis] < lb.position[axis];
+		return la.normal[axis - 3] < lb.normal[axis - 3];
+	});
+
+	unsigned int index = next++;
+	int left = buildRange(vpls, indices, normalWeight, order, begin, mid, next, tree);
+	int right = buildRange(vpls, indices, normalWeight, order, mid, end, next, tree);
+
+	LightTree::Node& l = tree[left];
+	LightTree::Node& r = tree[right];
+	LightTree::Node& node = tree[index];
+	const LightTree::Node& rep = getPower(l.diffuse) >= getPower(r.diffuse) ? l : r;
+	node.position = rep.position;
+	node.diffuse = glm::vec4(glm::vec3(l.diffuse) + glm::vec3(r.diffuse), rep.diffuse.w);
+	node.min = glm::vec4(glm::min(glm::vec3(l.min), glm::vec3(r.min)), left);
+	node.max = glm::vec4(glm::max(glm::vec3(l.max), glm::vec3(r.max)), right);
+	node.link = glm::vec4(-1, index, 0, 0);
+	l.link.x = index;
+	r.link.x = index;
+	return index;
+}
+}
+
+unsigned int LightTree::getTreeSize(unsigned int noOfLeaves) {
+	return noOfLeaves > 0 ? (2 * noOfLeaves) - 1 : 0;
+}
+
+unsigned int LightTree::getRoot(unsigned int noOfLeaves) {
+	return noOfLeaves > 1 ? noOfLeaves : 0;
+}
+
+void LightTree::build(const std::vector<Light>& vpls, const std::vector<unsigned int>& indices, const std::vector<float>& pathDists, float normalWeight, std::vector<Node>& nodes) {
+	unsigned int noOfLeaves = indices.size();
+	if (noOfLeaves == 0)
+		return;
+
+	unsigned int base = nodes.size();
+	nodes.resize(base + getTreeSize(noOfLeaves));
+	std::vector<Node> tree(getTreeSize(noOfLeaves));
+
+	std::vector<unsigned int> order(noOfLeaves);
+	for (unsigned int i = 0; i < noOfLeaves; ++i) {
+		const Light& vpl = vpls[indices[i]];
+		Node& leaf = tree[i];
+		leaf.position = glm::vec4(glm::vec3(vpl.position), pathDists[i]);
+		leaf.diffuse = glm::vec4(glm::vec3(vpl.diffuse), indices[i]);
+		leaf.min = glm::vec4(glm::vec3(vpl.position), -1);
+		leaf.max = glm::vec4(glm::vec3(vpl.position), -1);
+		leaf.link = glm::vec4(-1, i, 0, 0);
+		order[i] = i;
+	}
+
+	unsigned int next = noOfLeaves;
+	buildRange(vpls, indices, normalWeight, order, 0, noOfLeaves, next, tree);
+
+	//Walk up from each leaf while its parent kept the same representative
+	for (unsigned int i = 0; i < noOfLeaves; ++i) {
+		int top = i;
+		while (tree[top].link.x >= 0 && tree[(int)tree[top].link.x].diffuse.w == tree[i].diffuse.w)
+			top = tree[top].link.x;
+		tree[i].link.y = top;
+	}
+
+	std::copy(tree.begin(), tree.end(), nodes.begin() + base);
+}
@@ -6,6 +6,10 @@
 #include "renderer.h"
 #include "model.h"
 #include "camera.h"
+#include "profiler.h"
+#include "benchmark.h"
+#include "recorder.h"
+#include "resources.h"
 
 int main(int argc, char** args) {
 	if (argc >= 2)
@@ -37,7 +41,14 @@ int main(int argc, char** args) {
 	else if (!Model::init(config, renderer::getIntersectionApi())) {
 		std::cerr << "Failed to initialise model" << std::endl;
 	}
+	else if (!Benchmark::init(config)) {
+		std::cerr << "Failed to initialise benchmark" << std::endl;
+	}
+	else if (!Recorder::init(config)) {
+		std::cerr << "Failed to initialise recorder" << std::endl;
+	}
 	else {
+		std::cout << Resources::getSummary(false);
 		interface::loop();
 	}
 
@@ -50,8 +61,12 @@ int main(int argc, char** args) {
 	file.open(outPath.c_str());
 	file << Model::getTimeIntervals();
 	file << renderer::getTimeIntervals();
+	file << Profiler::getSummary();
+	file << Resources::getSummary(true);
 	file.close();
+	Profiler::exportAll();
 
+	Recorder::destroy();
 	Model::destroy();
 	renderer::destroy();
 	interface::destroy();
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <cstring>
@@ -9,9 +11,14 @@
 #include <sstream>
 
 #include "model.h"
+#include "profiler.h"
+#include "resources.h"
+#include "scene.h"
 
 namespace RR = RadeonRays;
 
+#define MODEL_PARALLEL_HITS 256
+
 struct Vertex {
 	glm::vec3 position;
 	glm::vec3 normal;
@@ -26,6 +33,9 @@ struct Material {
 	glm::vec3 transmittance;
 	float shininess;
 	unsigned int diffuse_texture;
+	unsigned int diffuse_width;
+	unsigned int diffuse_height;
+	std::vector<glm::vec3> diffuse_texels;
 	unsigned int specular_texture;
 	unsigned int bump_texture;
 	unsigned int mask_texture;
@@ -35,6 +45,16 @@ struct Material {
 	SDL_Surface* mask_surface;
 };
 
+//Corner 0 plus edges to corners 1 and 2, so interpolating at barycentrics x, y is two multiply-adds
+struct Triangle {
+	glm::vec3 normal;
+	glm::vec3 normalU;
+	glm::vec3 normalV;
+	glm::vec2 texCoord;
+	glm::vec2 texCoordU;
+	glm::vec2 texCoordV;
+};
+
 struct Mesh {
 	unsigned int vao;
 	unsigned int vbo;
@@ -42,6 +62,7 @@ struct Mesh {
 	Material* material;
 	RR::Shape* shape;
 	std::vector<Vertex> vertices;
+	std::vector<Triangle> triangles;
 	glm::mat4* model;
 };
 
@@ -59,13 +80,117 @@ RR::matrix dModel;
 RR::matrix dModelInverse;
 unsigned int dModelIndex;
 float dModelTimer = 0;
+glm::vec3 dBoundsMin, dBoundsMax;
 
-float bvhConstructionIA = 0;
-float mintervalStart = 0;
-float mintervalEnd = 0;
-unsigned int mnoOfFrames = 0;
+unsigned int bvhConstructionStage = -1;
 
 RR::IntersectionApi* rIAPI;
+std::vector<RR::Shape*> attachedShapes;
+
+//http://sdl.beuc.net/sdl.wiki/Pixel_Access
+Uint32 getpixel(SDL_Surface* surface, int x, int y)
+{
+	if (x < 0) x = 0;
+	if (y < 0) y = 0;
+
+	int bpp = surface->format->BytesPerPixel;
+	/* Here p is the address to the pixel we want to retrieve */
+	Uint8* p = (Uint8*)surface->pixels + y * surface->pitch + x * bpp;
+
+	switch (bpp) {
+	case 1:
+		return *p;
+		break;
+
+	case 2:
+		return *(Uint16*)p;
+		break;
+
+	case 3:
+		if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
+			return p[0] << 16 | p[1] << 8 | p[2];
+		else
+			return p[0] | p[1] << 8 | p[2] << 16;
+		break;
+
+	case 4:
+		return *(Uint32*)p;
+		break;
+
+	default:
+		return 0;       /* shouldn't happen, but avoids warnings */
+	}
+}
+
+void buildTriangles(Mesh& mesh) {
+	mesh.triangles.resize(mesh.vertices.size() / 3);
+	for (unsigned int t = 0; t < mesh.triangles.size(); ++t) {
+		const Vertex& v0 = mesh.vertices[t * 3 + 0];
+		const Vertex& v1 = mesh.vertices[t * 3 + 1];
+		const Vertex& v2 = mesh.vertices[t * 3 + 2];
+		Triangle& triangle = mesh.triangles[t];
+		triangle.normal = v0.normal;
+		triangle.normalU = v1.normal - v0.normal;
+		triangle.normalV = v2.normal - v0.normal;
+		triangle.texCoord = v0.texCoord;
+		triangle.texCoordU = v1.texCoord - v0.texCoord;
+		triangle.texCoordV = v2.texCoord - v0.texCoord;
+	}
+}
+
+//Decoded once at load so lookups skip the pixel format entirely
+void convertTexels(Material& material, SDL_Surface* surface) {
+	material.diffuse_width = surface->w;
+	material.diffuse_height = surface->h;
+	material.diffuse_texels.resize(surface->w * surface->h);
+	for (int y = 0; y < surface->h; ++y) {
+		for (int x = 0; x < surface->w; ++x) {
+			Uint8 rgb[3];
+			SDL_GetRGB(getpixel(surface, x, y), surface->format, &rgb[0], &rgb[1], &rgb[2]);
+			material.diffuse_texels[y * surface->w + x] = glm::vec3(rgb[0], rgb[1], rgb[2]) / 255.f;
+		}
+	}
+}
+
+//Texture coordinates wrap like GL_REPEAT
+glm::vec3 getTexel(const Material& material, glm::vec2 texCoord) {
+	unsigned int u = (texCoord.x - std::floor(texCoord.x)) * material.diffuse_width;
+	unsigned int v = (texCoord.y - std::floor(texCoord.y)) * material.diffuse_height;
+	u = std::min(u, material.diffuse_width - 1);
+	v = std::min(v, material.diffuse_height - 1);
+	return material.diffuse_texels[v * material.diffuse_width + u];
+}
+
+RR::Shape* createShape(RR::IntersectionApi* intersectionApi, const Mesh& mesh, unsigned int id, const RR::matrix& model, const RR::matrix& modelInverse) {
+	int indices[mesh.vertices.size()];
+	for (int i = 0; i < mesh.vertices.size(); ++i) {
+		indices[i] = i;
+	}
+
+	int numfaces = mesh.vertices.size() / 3;
+	int numfaceverts[numfaces];
+	for (int i = 0; i < numfaces; ++i) {
+		numfaceverts[i] = 3;
+	}
+
+	RR::Shape* shape = intersectionApi->CreateMesh((const float*)mesh.vertices.data(), mesh.count, sizeof(Vertex), indices, 0, numfaceverts, numfaces);
+	shape->SetTransform(model, modelInverse);
+	shape->SetId(id);
+	intersectionApi->AttachShape(shape);
+	return shape;
+}
+
+//The traced translation reuses x for z, bounds have to follow what is traced rather than what is drawn
+glm::vec3 getDynamicOffset(float time) {
+	float ratio = fmod(time, 20.f) / 20;
+	glm::vec3 dModelPos = (dModelPosStart * (1 - ratio)) + (dModelPosEnd * ratio);
+	return glm::vec3(dModelPos.x, dModelPos.y, dModelPos.x);
+}
+
+RR::matrix getDynamicTransform(float time) {
+	glm::vec3 offset = getDynamicOffset(time);
+	return RR::translation(RR::float3(offset.x, offset.y, offset.z));
+}
 
 void load(std::string path, tinyobj::attrib_t attrib, std::vector<tinyobj::shape_t> shapes, std::vector<tinyobj::material_t> mats, RR::IntersectionApi* intersectionApi, RR::matrix& model, RR::matrix& modelInverse, glm::mat4* gmodel) {
 	unsigned int materials_start = materials.size();
@@ -95,19 +220,23 @@ void load(std::string path, tinyobj::attrib_t attrib, std::vector<tinyobj::shape
 		material.shininess = mat.shininess;
 
 		material.diffuse_texture = 0;
+		material.diffuse_width = 0;
+		material.diffuse_height = 0;
 		if (mat.diffuse_texname != "") {
-			SDL_Surface* surface = IMG_Load((path + mat.diffuse_texname).c_str());
+			SDL_Surface* surface = Scene::isTexture(mat.diffuse_texname) ? Scene::createTexture(mat.diffuse_texname) : IMG_Load((path + mat.diffuse_texname).c_str());
 			if (!surface) {
 				std::cerr << "Failed to load diffuse texture " << path << mat.diffuse_texname << ": " << IMG_GetError() << std::endl;
 			}
 
 			glGenTextures(1, &material.diffuse_texture);
 			glActiveTexture(GL_TEXTURE0);
+			Resources::addTexture("Model", path + mat.diffuse_texname + " #" + std::to_string(materials.size()), GL_RGB, surface->w, surface->h, 1);
 			glBindTexture(GL_TEXTURE_2D, material.diffuse_texture);
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, surface->w, surface->h, 0, GL_RGB, GL_UNSIGNED_BYTE, surface->pixels);
 			glGenerateMipmap(GL_TEXTURE_2D);
 
 			material.diffuse_surface = surface;
+			convertTexels(material, surface);
 		}
 
 		material.specular_texture = 0;
@@ -119,6 +248,7 @@ void load(std::string path, tinyobj::attrib_t attrib, std::vector<tinyobj::shape
 
 			glGenTextures(1, &material.specular_texture);
 			glActiveTexture(GL_TEXTURE0);
+			Resources::addTexture("Model", path + mat.specular_texname + " #" + std::to_string(materials.size()), GL_RED, surface->w, surface->h, 1);
 			glBindTexture(GL_TEXTURE_2D, material.specular_texture);
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, surface->w, surface->h, 0, GL_RED, GL_UNSIGNED_BYTE, surface->pixels);
 			glGenerateMipmap(GL_TEXTURE_2D);
@@ -135,6 +265,7 @@ void load(std::string path, tinyobj::attrib_t attrib, std::vector<tinyobj::shape
 
 			glGenTextures(1, &material.bump_texture);
 			glActiveTexture(GL_TEXTURE0);
+			Resources::addTexture("Model", path + mat.bump_texname + " #" + std::to_string(materials.size()), GL_RED, surface->w, surface->h, 1);
 			glBindTexture(GL_TEXTURE_2D, material.bump_texture);
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, surface->w, surface->h, 0, GL_RED, GL_UNSIGNED_BYTE, surface->pixels);
 			glGenerateMipmap(GL_TEXTURE_2D);
@@ -151,6 +282,7 @@ void load(std::string path, tinyobj::attrib_t attrib, std::vector<tinyobj::shape
 
 			glGenTextures(1, &material.mask_texture);
 			glActiveTexture(GL_TEXTURE0);
+			Resources::addTexture("Model", path + mat.alpha_texname + " #" + std::to_string(materials.size()), GL_RED, surface->w, surface->h, 1);
 			glBindTexture(GL_TEXTURE_2D, material.mask_texture);
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, surface->w, surface->h, 0, GL_RED, GL_UNSIGNED_BYTE, surface->pixels);
 			glGenerateMipmap(GL_TEXTURE_2D);
@@ -195,6 +327,7 @@ void load(std::string path, tinyobj::attrib_t attrib, std::vector<tinyobj::shape
 
 		mesh.count = mesh.vertices.size();
 		mesh.material = &(materials[materials_start + shape.mesh.material_ids[0]]);
+		buildTriangles(mesh);
 
 		glGenBuffers(1, &mesh.vbo);
 		glGenVertexArrays(1, &mesh.vao);
@@ -202,6 +335,7 @@ void load(std::string path, tinyobj::attrib_t attrib, std::vector<tinyobj::shape
 		glBindVertexArray(mesh.vao);
 		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
 
+		Resources::addBuffer("Model", path + shape.name + " #" + std::to_string(meshes.size()), "GL buffer", mesh.count * sizeof(Vertex));
 		glBufferData(GL_ARRAY_BUFFER, mesh.count * sizeof(Vertex), mesh.vertices.data(), GL_STATIC_DRAW);
 
 		glEnableVertexAttribArray(0);
@@ -215,22 +349,8 @@ void load(std::string path, tinyobj::attrib_t attrib, std::vector<tinyobj::shape
 
 		glBindVertexArray(0);
 
-		int indices[mesh.vertices.size()];
-		for (int i = 0; i < mesh.vertices.size(); ++i) {
-			indices[i] = i;
-		}
-
-		int numfaces = mesh.vertices.size() / 3;
-		int numfaceverts[numfaces];
-		for (int i = 0; i < numfaces; ++i) {
-			numfaceverts[i] = 3;
-		}
-
 		mesh.model = gmodel;
-		mesh.shape = intersectionApi->CreateMesh((const float*)mesh.vertices.data(), mesh.count, sizeof(Vertex), indices, 0, numfaceverts, numfaces);
-		mesh.shape->SetTransform(model, modelInverse);
-		mesh.shape->SetId(meshes.size());
-		intersectionApi->AttachShape(mesh.shape);
+		mesh.shape = createShape(intersectionApi, mesh, meshes.size(), model, modelInverse);
 
 		meshes.push_back(mesh);
 	}
@@ -243,6 +363,7 @@ bool Model::init(INIReader config, RR::IntersectionApi* intersectionApi) {
 		return false;
 	}
 
+	bvhConstructionStage = Profiler::addStage("BVH Construction");
 	materials.reserve(512);
 
 	std::string filename = config.Get("model", "filename", "INVALID");
@@ -257,12 +378,17 @@ bool Model::init(INIReader config, RR::IntersectionApi* intersectionApi) {
 	std::vector<tinyobj::material_t> mats;
 	std::string warn;
 	std::string err;
-	if (!tinyobj::LoadObj(&attrib, &shapes, &mats, &warn, &err, (path + filename).c_str(), path.c_str())) {
+	bool synthetic = Scene::isEnabled(config);
+	if (synthetic) {
+		path = "";
+		Scene::generate(config, attrib, shapes, mats);
+	}
+	else if (!tinyobj::LoadObj(&attrib, &shapes, &mats, &warn, &err, (path + filename).c_str(), path.c_str())) {
 		std::cerr << "Failed to load Model: " << err << std::endl;
 		return false;
 	}
 
-	float scale = config.GetReal("model", "scale", 1.f);
+	float scale = synthetic ? 1.f : config.GetReal("model", "scale", 1.f);
 	model = glm::mat4(1.0f);
 	model = glm::scale(model, glm::vec3(scale));
 	for (int x = 0; x < 4; ++x)
@@ -288,6 +414,14 @@ bool Model::init(INIReader config, RR::IntersectionApi* intersectionApi) {
 
 		load(dpath, dattrib, shapes, mats, intersectionApi, dModel, dModelInverse, &dynModel);
 	}
+	dBoundsMin = glm::vec3(INFINITY);
+	dBoundsMax = glm::vec3(-INFINITY);
+	for (unsigned int i = dModelIndex; i < meshes.size(); ++i) {
+		for (const auto& vertex : meshes[i].vertices) {
+			dBoundsMin = glm::min(dBoundsMin, vertex.position);
+			dBoundsMax = glm::max(dBoundsMax, vertex.position);
+		}
+	}
 
 	intersectionApi->Commit();
 	rIAPI = intersectionApi;
@@ -324,87 +458,91 @@ void Model::draw(unsigned int shader) {
 }
 
 void Model::update(float deltaTime) {
-	mintervalStart = SDL_GetTicks();
+	Profiler::beginCPU(bvhConstructionStage);
 
 	dModelTimer += deltaTime;
 	float ratio = fmod(dModelTimer, 20.f) / 20;
 	glm::vec3 dModelPos = (dModelPosStart * (1 - ratio)) + (dModelPosEnd * ratio);
 	dynModel = glm::mat4(1.f);
 	dynModel = glm::translate(dynModel, dModelPos);
-	dModel = RR::translation(RR::float3(dModelPos.x, dModelPos.y, dModelPos.x));
+	dModel = getDynamicTransform(dModelTimer);
 	dModelInverse = RR::inverse(dModel);
 	for (int i = dModelIndex; i < meshes.size(); ++i) {
 		meshes[i].shape->SetTransform(dModel, dModelInverse);
 	}
 	rIAPI->Commit();
 
-	mintervalEnd = SDL_GetTicks();
-	bvhConstructionIA = ((bvhConstructionIA * mnoOfFrames) + mintervalEnd - mintervalStart) / (mnoOfFrames + 1);
-	mintervalStart = mintervalEnd;
-	mnoOfFrames++;
+	Profiler::endCPU(bvhConstructionStage);
 }
 
-void Model::destroy() {
-	IMG_Quit();
+//Copies every mesh into another intersection api, so a second thread can trace without sharing the main one.
+//Dynamic meshes are placed from time, dModel belongs to the render thread's update
+void Model::attach(RR::IntersectionApi* intersectionApi, float time) {
+	RR::matrix transform = getDynamicTransform(time);
+	RR::matrix transformInverse = RR::inverse(transform);
+	for (unsigned int i = 0; i < meshes.size(); ++i) {
+		if (i < dModelIndex)
+			createShape(intersectionApi, meshes[i], i, sModel, sModelInverse);
+		else
+			attachedShapes.push_back(createShape(intersectionApi, meshes[i], i, transform, transformInverse));
+	}
+	intersectionApi->Commit();
 }
 
-glm::mat4 Model::getModelMatrix() {
-	return model;
+//Moves the attached dynamic meshes to where they are at time, the caller owns that api
+void Model::updateAttached(RR::IntersectionApi* intersectionApi, float time) {
+	if (attachedShapes.empty())
+		return;
+	RR::matrix transform = getDynamicTransform(time);
+	RR::matrix transformInverse = RR::inverse(transform);
+	for (RR::Shape* shape : attachedShapes)
+		shape->SetTransform(transform, transformInverse);
+	intersectionApi->Commit();
 }
 
-//http://sdl.beuc.net/sdl.wiki/Pixel_Access
-Uint32 getpixel(SDL_Surface* surface, int x, int y)
-{
-	if (x < 0) x = 0;
-	if (y < 0) y = 0;
-
-	int bpp = surface->format->BytesPerPixel;
-	/* Here p is the address to the pixel we want to retrieve */
-	Uint8* p = (Uint8*)surface->pixels + y * surface->pitch + x * bpp;
-
-	switch (bpp) {
-	case 1:
-		return *p;
-		break;
-
-	case 2:
-		return *(Uint16*)p;
-		break;
-
-	case 3:
-		if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
-			return p[0] << 16 | p[1] << 8 | p[2];
-		else
-			return p[0] | p[1] << 8 | p[2] << 16;
-		break;
-
-	case 4:
-		return *(Uint32*)p;
-		break;
+void Model::destroy() {
+	IMG_Quit();
+}
 
-	default:
-		return 0;       /* shouldn't happen, but avoids warnings */
+//CPU-side mesh with a flat material and no GL or RadeonRays resources, for tools that run without a context
+void Model::addMesh(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& texCoords, glm::vec3 diffuse) {
+	if (materials.capacity() == 0)
+		materials.reserve(512);
+
+	Material material = {};
+	material.diffuse = diffuse;
+	materials.push_back(material);
+
+	Mesh mesh;
+	for (unsigned int i = 0; i < positions.size(); ++i) {
+		Vertex vertex;
+		vertex.position = positions[i];
+		vertex.normal = normals[i];
+		vertex.color = glm::vec3(1.0f, 1.0f, 1.0f);
+		vertex.texCoord = i < texCoords.size() ? texCoords[i] : glm::vec2(0);
+		mesh.vertices.push_back(vertex);
 	}
+	mesh.count = mesh.vertices.size();
+	mesh.material = &materials.back();
+	buildTriangles(mesh);
+	mesh.vao = 0;
+	mesh.vbo = 0;
+	mesh.shape = nullptr;
+	mesh.model = &model;
+	meshes.push_back(mesh);
+}
+
+glm::mat4 Model::getModelMatrix() {
+	return model;
 }
 
 glm::vec4 Model::getDiffuse(unsigned int mesh_id, unsigned int face_id, float x, float y) {
 	glm::vec4 diffuse = glm::vec4(0);
-	if (0 <= mesh_id && mesh_id < meshes.size() && 0 <= face_id && (face_id * 3) + 2 < meshes[mesh_id].vertices.size()) {
-		Mesh mesh = meshes[mesh_id];
-		Vertex v0 = mesh.vertices[face_id * 3 + 0];
-		Vertex v1 = mesh.vertices[face_id * 3 + 1];
-		Vertex v2 = mesh.vertices[face_id * 3 + 2];
-		if (mesh.material->diffuse_texture) {
-			int u, v;
-			u = (1 - x - y) * v0.texCoord.x + x * v1.texCoord.x + y * v2.texCoord.x;
-			v = (1 - x - y) * v0.texCoord.y + x * v1.texCoord.y + y * v2.texCoord.y;
-			//Uint8* pixel = (Uint8*)mesh.material->diffuse_surface->pixels + v * mesh.material->diffuse_surface->pitch + u * 3;
-			//glm::vec3 diffuse = glm::vec3(pixel[0]/255.f, pixel[1]/255.f, pixel[2]/255.f);
-			Uint32 pixel = getpixel(mesh.material->diffuse_surface, u, v);
-			Uint8 rgb[3];
-
-			SDL_GetRGB(pixel, mesh.material->diffuse_surface->format, &rgb[0], &rgb[1], &rgb[2]);
-			diffuse = glm::vec4(rgb[0], rgb[1], rgb[2], 255) / 255.f;
+	if (0 <= mesh_id && mesh_id < meshes.size() && 0 <= face_id && face_id < meshes[mesh_id].triangles.size()) {
+		const Mesh& mesh = meshes[mesh_id];
+		const Triangle& triangle = mesh.triangles[face_id];
+		if (mesh.material->diffuse_width) {
+			diffuse = glm::vec4(getTexel(*mesh.material, triangle.texCoord + x * triangle.texCoordU + y * triangle.texCoordV), 1);
 		}
 		else {
 			diffuse = glm::vec4(mesh.material->diffuse, 1);
@@ -418,19 +556,18 @@ glm::vec4 Model::getDiffuse(unsigned int mesh_id, unsigned int face_id, float x,
 
 glm::vec4 Model::getSpecular(unsigned int mesh_id, unsigned int face_id, float x, float y) {
 	glm::vec4 specular = glm::vec4(0);
-	if (0 <= mesh_id && mesh_id < meshes.size() && 0 <= face_id && (face_id * 3) + 2 < meshes[mesh_id].vertices.size()) {
-		Mesh mesh = meshes[mesh_id];
-		Vertex v0 = mesh.vertices[face_id * 3 + 0];
-		Vertex v1 = mesh.vertices[face_id * 3 + 1];
-		Vertex v2 = mesh.vertices[face_id * 3 + 2];
+	if (0 <= mesh_id && mesh_id < meshes.size() && 0 <= face_id && face_id < meshes[mesh_id].triangles.size()) {
+		const Mesh& mesh = meshes[mesh_id];
+		const Triangle& triangle = mesh.triangles[face_id];
 		if (mesh.material->specular_texture) {
-			int u, v;
-			u = (1 - x - y) * v0.texCoord.x + x * v1.texCoord.x + y * v2.texCoord.x;
-			v = (1 - x - y) * v0.texCoord.y + x * v1.texCoord.y + y * v2.texCoord.y;
-			Uint32 pixel = getpixel(mesh.material->specular_surface, u, v);
+			glm::vec2 texCoord = triangle.texCoord + x * triangle.texCoordU + y * triangle.texCoordV;
+			SDL_Surface* surface = mesh.material->specular_surface;
+			int u = glm::min(int((texCoord.x - std::floor(texCoord.x)) * surface->w), surface->w - 1);
+			int v = glm::min(int((texCoord.y - std::floor(texCoord.y)) * surface->h), surface->h - 1);
+			Uint32 pixel = getpixel(surface, u, v);
 			Uint8 rgb[3];
 
-			SDL_GetRGB(pixel, mesh.material->specular_surface->format, &rgb[0], &rgb[1], &rgb[2]);
+			SDL_GetRGB(pixel, surface->format, &rgb[0], &rgb[1], &rgb[2]);
 			specular = glm::vec4(rgb[0], rgb[1], rgb[2], 255) / 255.f;
 		}
 		else {
@@ -445,15 +582,9 @@ glm::vec4 Model::getSpecular(unsigned int mesh_id, unsigned int face_id, float x
 
 glm::vec4 Model::getNormal(unsigned int mesh_id, unsigned int face_id, float x, float y) {
 	glm::vec4 normal = glm::vec4(0);
-	if (0 <= mesh_id && mesh_id < meshes.size() && 0 <= face_id && (face_id * 3) + 2 < meshes[mesh_id].vertices.size()) {
-		Mesh mesh = meshes[mesh_id];
-		Vertex v0 = mesh.vertices[face_id * 3 + 0];
-		Vertex v1 = mesh.vertices[face_id * 3 + 1];
-		Vertex v2 = mesh.vertices[face_id * 3 + 2];
-		normal.x = (1 - x - y) * v0.normal.x + x * v1.normal.x + y * v2.normal.x;
-		normal.y = (1 - x - y) * v0.normal.y + x * v1.normal.y + y * v2.normal.y;
-		normal.z = (1 - x - y) * v0.normal.z + x * v1.normal.z + y * v2.normal.z;
-		normal.w = 0;
+	if (0 <= mesh_id && mesh_id < meshes.size() && 0 <= face_id && face_id < meshes[mesh_id].triangles.size()) {
+		const Triangle& triangle = meshes[mesh_id].triangles[face_id];
+		normal = glm::vec4(triangle.normal + x * triangle.normalU + y * triangle.normalV, 0);
 	}
 	else {
 		//std::cout << "Model::getNormal : Out of Bounds" << std::endl;
@@ -461,8 +592,84 @@ glm::vec4 Model::getNormal(unsigned int mesh_id, unsigned int face_id, float x,
 	return normal;
 }
 
+//Misses and out of range hits come back zeroed, hits are independent so large batches are split across threads
+void Model::getSurfaces(const RR::Intersection* isects, const RR::ray* rays, unsigned int noOfHits, Surfaces& surfaces) {
+	for (std::vector<float>* v : { &surfaces.px, &surfaces.py, &surfaces.pz, &surfaces.nx, &surfaces.ny, &surfaces.nz, &surfaces.r, &surfaces.g, &surfaces.b })
+		v->resize(noOfHits);
+
+	#pragma omp parallel for if(noOfHits >= MODEL_PARALLEL_HITS)
+	for (int i = 0; i < (int)noOfHits; ++i) {
+		const RR::Intersection& isect = isects[i];
+		glm::vec3 position = glm::vec3(0);
+		glm::vec3 normal = glm::vec3(0);
+		glm::vec3 albedo = glm::vec3(0);
+		if (isect.shapeid >= 0 && isect.shapeid < (int)meshes.size() && isect.primid >= 0 && isect.primid < (int)meshes[isect.shapeid].triangles.size()) {
+			const Mesh& mesh = meshes[isect.shapeid];
+			const Triangle& triangle = mesh.triangles[isect.primid];
+			float x = isect.uvwt.x;
+			float y = isect.uvwt.y;
+			const RR::ray& ray = rays[i];
+			position = glm::vec3(ray.o.x, ray.o.y, ray.o.z) + isect.uvwt.w * glm::vec3(ray.d.x, ray.d.y, ray.d.z);
+			normal = triangle.normal + x * triangle.normalU + y * triangle.normalV;
+			if (mesh.material->diffuse_width)
+				albedo = getTexel(*mesh.material, triangle.texCoord + x * triangle.texCoordU + y * triangle.texCoordV);
+			else
+				albedo = mesh.material->diffuse;
+		}
+		surfaces.px[i] = position.x;
+		surfaces.py[i] = position.y;
+		surfaces.pz[i] = position.z;
+		surfaces.nx[i] = normal.x;
+		surfaces.ny[i] = normal.y;
+		surfaces.nz[i] = normal.z;
+		surfaces.r[i] = albedo.r;
+		surfaces.g[i] = albedo.g;
+		surfaces.b[i] = albedo.b;
+	}
+}
+
+void Model::getTriangles(std::vector<glm::vec4>& triangles) {
+	triangles.clear();
+	for (const auto& mesh : meshes) {
+		glm::mat4 transform = *mesh.model;
+		for (const auto& vertex : mesh.vertices)
+			triangles.push_back(transform * glm::vec4(vertex.position, 1));
+	}
+}
+
+bool Model::hasDynamicMeshes() {
+	return dModelIndex < meshes.size();
+}
+
+//Box around everything the dynamic meshes covered between two times, the motion is linear apart from wrapping back to the start
+bool Model::getDynamicBounds(float from, float to, glm::vec3& min, glm::vec3& max) {
+	if (!hasDynamicMeshes())
+		return false;
+	glm::vec3 start = getDynamicOffset(from);
+	glm::vec3 end = getDynamicOffset(to);
+	min = glm::min(start, end);
+	max = glm::max(start, end);
+	if (floor(from / 20) != floor(to / 20) || to < from) {
+		glm::vec3 first = getDynamicOffset(0);
+		glm::vec3 last = glm::vec3(dModelPosEnd.x, dModelPosEnd.y, dModelPosEnd.x);
+		min = glm::min(min, glm::min(first, last));
+		max = glm::max(max, glm::max(first, last));
+	}
+	min += dBoundsMin;
+	max += dBoundsMax;
+	return true;
+}
+
+float Model::getTime() {
+	return dModelTimer;
+}
+
+void Model::setTime(float time) {
+	dModelTimer = time;
+}
+
 std::string Model::getTimeIntervals() {
 	std::stringstream intervals;
-	intervals << "BVH Construction : " << bvhConstructionIA << std::endl;
+	intervals << "BVH Construction : " << Profiler::getAverage(bvhConstructionStage) << std::endl;
 	return intervals.str();
 }
@@ -0,0 +1,506 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <SDL2/SDL.h>
+
+#include "profiler.h"
+
+#define PROFILER_HISTOGRAM_BINS 16
+#define PROFILER_HISTOGRAM_WIDTH 2
+
+#define DOMAIN_CPU 0
+#define DOMAIN_GL 1
+#define DOMAIN_CL 2
+
+#define PROFILER_NO_OF_STATISTICS 3
+
+namespace {
+const GLenum statisticTargets[PROFILER_NO_OF_STATISTICS] = { GL_VERTICES_SUBMITTED_ARB, GL_PRIMITIVES_SUBMITTED_ARB, GL_FRAGMENT_SHADER_INVOCATIONS_ARB };
+const char* statisticNames[PROFILER_NO_OF_STATISTICS] = { "Vertices", "Primitives", "Fragment Invocations" };
+
+struct Stage {
+	std::string name;
+	GLuint queries[PROFILER_LATENCY][2];
+	cl_event events[PROFILER_LATENCY][2];
+	bool pending[PROFILER_LATENCY];
+	unsigned int issued[PROFILER_LATENCY];
+	Uint64 cpuStart;
+	float average;
+	unsigned int samples;
+	bool statistics;
+	GLuint statisticQueries[PROFILER_LATENCY][PROFILER_NO_OF_STATISTICS];
+	unsigned int statisticCounters[PROFILER_NO_OF_STATISTICS];
+};
+
+struct Counter {
+	std::string name;
+	int stage;
+	double total;
+};
+
+//Begin times are in milliseconds on the clock of the domain that measured them
+struct Sample {
+	float begin = -1;
+	float duration = -1;
+	unsigned int domain = DOMAIN_CPU;
+};
+
+struct Record {
+	unsigned int frame;
+	float begin;
+	float duration;
+	std::vector<Sample> samples;
+	std::vector<double> counts;
+};
+
+cl_command_queue profilerQueue;
+std::vector<Stage> stages;
+std::vector<Counter> counters;
+unsigned int slot = 0;
+unsigned int frame = 0;
+
+std::vector<Record> records;
+Uint64 cpuBase;
+GLuint64 glBase = 0;
+cl_ulong clBase = 0;
+std::string csvPath;
+std::string tracePath;
+
+float cpuTime(Uint64 counter) {
+	return (counter - cpuBase) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+Record* getRecord(unsigned int f) {
+	if (records.empty() || f > frame || frame - f >= records.size())
+		return NULL;
+	Record& record = records[f % records.size()];
+	return record.frame == f ? &record : NULL;
+}
+
+void addSample(unsigned int s, unsigned int f, unsigned int domain, float begin, float ms) {
+	Stage& stage = stages[s];
+	stage.average = ((stage.average * stage.samples) + ms) / (stage.samples + 1);
+	stage.samples++;
+
+	Record* record = getRecord(f);
+	if (record == NULL)
+		return;
+	if (record->samples.size() <= s)
+		record->samples.resize(stages.size());
+	record->samples[s].begin = begin;
+	record->samples[s].duration = ms;
+	record->samples[s].domain = domain;
+}
+
+void addCount(unsigned int c, unsigned int f, double value) {
+	counters[c].total += value;
+
+	Record* record = getRecord(f);
+	if (record == NULL)
+		return;
+	if (record->counts.size() <= c)
+		record->counts.resize(counters.size(), 0);
+	record->counts[c] += value;
+}
+
+//Resolves whatever the slot last recorded, a result that is still not ready is dropped rather than waited on
+void resolve(unsigned int s, unsigned int r) {
+	Stage& stage = stages[s];
+	if (!stage.pending[r])
+		return;
+	stage.pending[r] = false;
+
+	if (stage.events[r][0] != NULL) {
+		cl_int status;
+		clGetEventInfo(stage.events[r][1], CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL);
+		if (status == CL_COMPLETE) {
+			cl_ulong start, end;
+			clGetEventProfilingInfo(stage.events[r][0], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &start, NULL);
+			clGetEventProfilingInfo(stage.events[r][1], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+			if (clBase == 0)
+				clBase = start;
+			addSample(s, stage.issued[r], DOMAIN_CL, (start - clBase) / 1000000.0, (end - start) / 1000000.0);
+		}
+		clReleaseEvent(stage.events[r][0]);
+		clReleaseEvent(stage.events[r][1]);
+		stage.events[r][0] = NULL;
+		stage.events[r][1] = NULL;
+		return;
+	}
+
+	GLint available = 0;
+	glGetQueryObjectiv(stage.queries[r][1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available) {
+		GLuint64 start, end;
+		glGetQueryObjectui64v(stage.queries[r][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(stage.queries[r][1], GL_QUERY_RESULT, &end);
+		if (glBase == 0)
+			glBase = start;
+		addSample(s, stage.issued[r], DOMAIN_GL, (start - glBase) / 1000000.0, (end - start) / 1000000.0);
+	}
+	if (stage.statistics) {
+		for (unsigned int i = 0; i < PROFILER_NO_OF_STATISTICS; ++i) {
+			glGetQueryObjectiv(stage.statisticQueries[r][i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+			GLuint64 value;
+			glGetQueryObjectui64v(stage.statisticQueries[r][i], GL_QUERY_RESULT, &value);
+			addCount(stage.statisticCounters[i], stage.issued[r], value);
+		}
+	}
+}
+}
+
+float Profiler::percentile(std::vector<float>& values, float p) {
+	if (values.empty())
+		return 0;
+	unsigned int index = std::min((unsigned int)(p * (values.size() - 1) + 0.5f), (unsigned int)values.size() - 1);
+	std::nth_element(values.begin(), values.begin() + index, values.end());
+	return values[index];
+}
+
+namespace {
+//Oldest first, skipping slots that were never filled
+std::vector<const Record*> getOrderedRecords() {
+	std::vector<const Record*> ordered;
+	unsigned int first = frame >= records.size() ? frame - records.size() + 1 : 1;
+	for (unsigned int f = first; f <= frame; ++f) {
+		const Record* record = getRecord(f);
+		if (record != NULL && record->duration >= 0)
+			ordered.push_back(record);
+	}
+	return ordered;
+}
+}
+
+void Profiler::setCapacity(unsigned int noOfFrames) {
+	records.assign(std::max(noOfFrames, 1u), Record());
+	for (auto& record : records)
+		record.frame = 0;
+}
+
+void Profiler::init(cl_command_queue queue, INIReader config) {
+	profilerQueue = queue;
+	setCapacity(config.GetInteger("profiler", "traceFrames", 1024));
+	csvPath = config.Get("profiler", "traceCSV", "");
+	tracePath = config.Get("profiler", "traceJSON", "");
+	cpuBase = SDL_GetPerformanceCounter();
+}
+
+unsigned int Profiler::addStage(const std::string& name) {
+	Stage stage = {};
+	stage.name = name;
+	glGenQueries(PROFILER_LATENCY * 2, &stage.queries[0][0]);
+	stages.push_back(stage);
+	return stages.size() - 1;
+}
+
+//Vertices, primitives and fragment invocations for a GL stage, where the driver exposes them
+void Profiler::enableStatistics(unsigned int stage) {
+	if (stage >= stages.size() || stages[stage].statistics || !GLEW_ARB_pipeline_statistics_query)
+		return;
+	glGenQueries(PROFILER_LATENCY * PROFILER_NO_OF_STATISTICS, &stages[stage].statisticQueries[0][0]);
+	for (unsigned int i = 0; i < PROFILER_NO_OF_STATISTICS; ++i)
+		stages[stage].statisticCounters[i] = addCounter(stages[stage].name + " " + statisticNames[i]);
+	stages[stage].statistics = true;
+}
+
+unsigned int Profiler::addCounter(const std::string& name, int stage) {
+	counters.push_back({ name, stage, 0 });
+	return counters.size() - 1;
+}
+
+void Profiler::count(unsigned int counter, double value) {
+	if (counter < counters.size())
+		addCount(counter, frame, value);
+}
+
+double Profiler::getCounterTotal(unsigned int counter) {
+	return counter < counters.size() ? counters[counter].total : 0;
+}
+
+void Profiler::beginFrame() {
+	Uint64 now = SDL_GetPerformanceCounter();
+	Record* previous = getRecord(frame);
+	if (previous != NULL)
+		previous->duration = cpuTime(now) - previous->begin;
+
+	frame++;
+	slot = (slot + 1) % PROFILER_LATENCY;
+	for (unsigned int s = 0; s < stages.size(); ++s)
+		resolve(s, slot);
+
+	if (!records.empty()) {
+		Record& record = records[frame % records.size()];
+		record.frame = frame;
+		record.begin = cpuTime(now);
+		record.duration = -1;
+		record.samples.assign(stages.size(), Sample());
+		record.counts.assign(counters.size(), 0);
+	}
+}
+
+void Profiler::beginGL(unsigned int stage) {
+	glQueryCounter(stages[stage].queries[slot][0], GL_TIMESTAMP);
+	if (stages[stage].statistics) {
+		for (unsigned int i = 0; i < PROFILER_NO_OF_STATISTICS; ++i)
+			glBeginQuery(statisticTargets[i], stages[stage].statisticQueries[slot][i]);
+	}
+}
+
+void Profiler::endGL(unsigned int stage) {
+	if (stages[stage].statistics) {
+		for (unsigned int i = 0; i < PROFILER_NO_OF_STATISTICS; ++i)
+			glEndQuery(statisticTargets[i]);
+	}
+	glQueryCounter(stages[stage].queries[slot][1], GL_TIMESTAMP);
+	stages[stage].pending[slot] = true;
+	stages[stage].issued[slot] = frame;
+}
+
+//Markers bracket everything enqueued in between, including the RadeonRays queries sharing the queue
+void Profiler::beginCL(unsigned int stage) {
+	clEnqueueMarkerWithWaitList(profilerQueue, 0, NULL, &stages[stage].events[slot][0]);
+}
+
+void Profiler::endCL(unsigned int stage) {
+	clEnqueueMarkerWithWaitList(profilerQueue, 0, NULL, &stages[stage].events[slot][1]);
+	stages[stage].pending[slot] = true;
+	stages[stage].issued[slot] = frame;
+}
+
+void Profiler::beginCPU(unsigned int stage) {
+	stages[stage].cpuStart = SDL_GetPerformanceCounter();
+}
+
+void Profiler::endCPU(unsigned int stage) {
+	float begin = cpuTime(stages[stage].cpuStart);
+	addSample(stage, frame, DOMAIN_CPU, begin, cpuTime(SDL_GetPerformanceCounter()) - begin);
+}
+
+//Work timed elsewhere, e.g. on another thread, is charged to the current frame as if it ended now
+void Profiler::recordCPU(unsigned int stage, float ms) {
+	float end = cpuTime(SDL_GetPerformanceCounter());
+	addSample(stage, frame, DOMAIN_CPU, end - ms, ms);
+}
+
+float Profiler::getAverage(unsigned int stage) {
+	return stage < stages.size() ? stages[stage].average : 0;
+}
+
+//The newest frame whose queries have all been read back, -1 when the stage did not run in it
+float Profiler::getLatest(unsigned int stage) {
+	const Record* record = frame > PROFILER_LATENCY ? getRecord(frame - PROFILER_LATENCY) : NULL;
+	if (record == NULL || stage >= record->samples.size())
+		return -1;
+	return record->samples[stage].duration;
+}
+
+bool Profiler::isLatestGPU(unsigned int stage) {
+	const Record* record = frame > PROFILER_LATENCY ? getRecord(frame - PROFILER_LATENCY) : NULL;
+	return record != NULL && stage < record->samples.size() && record->samples[stage].domain != DOMAIN_CPU;
+}
+
+double Profiler::getLatestCount(unsigned int counter) {
+	const Record* record = frame > PROFILER_LATENCY ? getRecord(frame - PROFILER_LATENCY) : NULL;
+	if (record == NULL || counter >= record->counts.size())
+		return 0;
+	return record->counts[counter];
+}
+
+const std::string& Profiler::getName(unsigned int stage) {
+	static const std::string unknown;
+	return stage < stages.size() ? stages[stage].name : unknown;
+}
+
+unsigned int Profiler::getNoOfStages() {
+	return stages.size();
+}
+
+//Waits for every outstanding query so the last frames are not missing from a report
+void Profiler::flush() {
+	glFinish();
+	clFinish(profilerQueue);
+	for (unsigned int r = 0; r < PROFILER_LATENCY; ++r) {
+		for (unsigned int s = 0; s < stages.size(); ++s)
+			resolve(s, r);
+	}
+	Record* last = getRecord(frame);
+	if (last != NULL && last->duration < 0)
+		last->duration = cpuTime(SDL_GetPerformanceCounter()) - last->begin;
+}
+
+//Drops everything recorded so far, samples from frames still in flight only reach the running means
+void Profiler::reset() {
+	for (auto& stage : stages) {
+		stage.average = 0;
+		stage.samples = 0;
+	}
+	for (auto& counter : counters)
+		counter.total = 0;
+	for (auto& record : records)
+		record.frame = 0;
+}
+
+std::vector<float> Profiler::getFrameTimes() {
+	std::vector<float> frameTimes;
+	for (const Record* record : getOrderedRecords())
+		frameTimes.push_back(record->duration);
+	return frameTimes;
+}
+
+std::vector<float> Profiler::getDurations(unsigned int stage) {
+	std::vector<float> durations;
+	for (const Record* record : getOrderedRecords()) {
+		if (stage < record->samples.size() && record->samples[stage].duration >= 0)
+			durations.push_back(record->samples[stage].duration);
+	}
+	return durations;
+}
+
+std::vector<double> Profiler::getCounts(unsigned int counter) {
+	std::vector<double> counts;
+	for (const Record* record : getOrderedRecords()) {
+		if (counter < record->counts.size())
+			counts.push_back(record->counts[counter]);
+	}
+	return counts;
+}
+
+std::string Profiler::getSummary() {
+	std::stringstream summary;
+	std::vector<const Record*> ordered = getOrderedRecords();
+	summary << "Frames Traced : " << ordered.size() << std::endl;
+
+	std::vector<float> frameTimes = getFrameTimes();
+	summary << "Frame Time p50/p95/p99/max : " << percentile(frameTimes, 0.5f) << " / " << percentile(frameTimes, 0.95f) << " / " << percentile(frameTimes, 0.99f) << " / " << percentile(frameTimes, 1.f) << std::endl;
+
+	for (unsigned int s = 0; s < stages.size(); ++s) {
+		std::vector<float> durations = getDurations(s);
+		if (durations.empty())
+			continue;
+		summary << stages[s].name << " p50/p95/p99/max : " << percentile(durations, 0.5f) << " / " << percentile(durations, 0.95f) << " / " << percentile(durations, 0.99f) << " / " << percentile(durations, 1.f) << std::endl;
+	}
+
+	//Rates only cover frames where the counter's stage was also timed
+	for (unsigned int c = 0; c < counters.size(); ++c) {
+		double total = 0;
+		double rateCount = 0;
+		double rateTime = 0;
+		unsigned int noOfFrames = 0;
+		for (const Record* record : ordered) {
+			if (c >= record->counts.size())
+				continue;
+			total += record->counts[c];
+			noOfFrames++;
+			int s = counters[c].stage;
+			if (s >= 0 && s < record->samples.size() && record->samples[s].duration > 0) {
+				rateCount += record->counts[c];
+				rateTime += record->samples[s].duration;
+			}
+		}
+		if (noOfFrames == 0 || total == 0)
+			continue;
+		summary << counters[c].name << " per frame : " << total / noOfFrames;
+		if (rateTime > 0)
+			summary << " (" << rateCount / rateTime / 1000 << " M/s)";
+		summary << std::endl;
+	}
+
+	unsigned int histogram[PROFILER_HISTOGRAM_BINS] = { 0 };
+	for (float time : frameTimes)
+		histogram[std::min((int)(time / PROFILER_HISTOGRAM_WIDTH), PROFILER_HISTOGRAM_BINS - 1)]++;
+	summary << "Frame Time Histogram (ms) :" << std::endl;
+	for (int b = 0; b < PROFILER_HISTOGRAM_BINS; ++b) {
+		summary << "  " << b * PROFILER_HISTOGRAM_WIDTH;
+		if (b < PROFILER_HISTOGRAM_BINS - 1)
+			summary << "-" << (b + 1) * PROFILER_HISTOGRAM_WIDTH;
+		else
+			summary << "+";
+		summary << " : " << histogram[b] << std::endl;
+	}
+	return summary.str();
+}
+
+bool Profiler::exportCSV(const std::string& path) {
+	std::ofstream file(path.c_str());
+	if (!file.is_open()) {
+		std::cerr << "Failed to open trace file " << path << std::endl;
+		return false;
+	}
+	file << "frame,frame_ms";
+	for (const auto& stage : stages)
+		file << "," << stage.name;
+	for (const auto& counter : counters)
+		file << "," << counter.name;
+	file << std::endl;
+	for (const Record* record : getOrderedRecords()) {
+		file << record->frame << "," << record->duration;
+		for (unsigned int s = 0; s < stages.size(); ++s) {
+			file << ",";
+			if (s < record->samples.size() && record->samples[s].duration >= 0)
+				file << record->samples[s].duration;
+		}
+		for (unsigned int c = 0; c < counters.size(); ++c) {
+			file << ",";
+			if (c < record->counts.size())
+				file << record->counts[c];
+		}
+		file << std::endl;
+	}
+	return true;
+}
+
+//Each clock domain gets its own track since GL, CL and CPU timestamps do not share an origin
+bool Profiler::exportTrace(const std::string& path) {
+	std::ofstream file(path.c_str());
+	if (!file.is_open()) {
+		std::cerr << "Failed to open trace file " << path << std::endl;
+		return false;
+	}
+	const char* tracks[3] = { "CPU", "OpenGL", "OpenCL" };
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+	for (int t = 0; t < 3; ++t)
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\"" << tracks[t] << "\"}}," << std::endl;
+	bool first = true;
+	for (const Record* record : getOrderedRecords()) {
+		file << (first ? "" : ",\n") << "{\"name\":\"Frame " << record->frame << "\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":" << record->begin * 1000 << ",\"dur\":" << record->duration * 1000 << "}";
+		first = false;
+		for (unsigned int s = 0; s < record->samples.size(); ++s) {
+			const Sample& sample = record->samples[s];
+			if (sample.duration < 0)
+				continue;
+			file << ",\n{\"name\":\"" << stages[s].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << sample.domain << ",\"ts\":" << sample.begin * 1000 << ",\"dur\":" << sample.duration * 1000 << ",\"args\":{\"frame\":" << record->frame << "}}";
+		}
+		for (unsigned int c = 0; c < record->counts.size(); ++c)
+			file << ",\n{\"name\":\"" << counters[c].name << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << record->begin * 1000 << ",\"args\":{\"value\":" << record->counts[c] << "}}";
+	}
+	file << std::endl << "]}" << std::endl;
+	return true;
+}
+
+void Profiler::exportAll() {
+	if (!csvPath.empty())
+		exportCSV(csvPath);
+	if (!tracePath.empty())
+		exportTrace(tracePath);
+}
+
+void Profiler::destroy() {
+	for (auto& stage : stages) {
+		glDeleteQueries(PROFILER_LATENCY * 2, &stage.queries[0][0]);
+		if (stage.statistics)
+			glDeleteQueries(PROFILER_LATENCY * PROFILER_NO_OF_STATISTICS, &stage.statisticQueries[0][0]);
+		for (unsigned int i = 0; i < PROFILER_LATENCY; ++i) {
+			if (stage.events[i][0] != NULL) {
+				clReleaseEvent(stage.events[i][0]);
+				clReleaseEvent(stage.events[i][1]);
+			}
+		}
+	}
+	stages.clear();
+	counters.clear();
+	records.clear();
+}
@@ -0,0 +1,132 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+
+#include "recorder.h"
+#include "camera.h"
+#include "renderer.h"
+#include "model.h"
+
+#define RECORDING_MAGIC "PGRC"
+#define RECORDING_VERSION 1
+
+namespace {
+std::string recordingPath;
+std::ofstream recording;
+unsigned int noOfRecordedFrames = 0;
+
+template <typename T>
+void writeValue(std::ofstream& file, const T& value) {
+	file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream& file, T& value) {
+	return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+bool startRecording() {
+	recording.open(recordingPath.c_str(), std::ios::binary | std::ios::trunc);
+	if (!recording.is_open()) {
+		std::cerr << "Failed to open recording " << recordingPath << std::endl;
+		return false;
+	}
+	recording.write(RECORDING_MAGIC, 4);
+	writeValue<uint32_t>(recording, RECORDING_VERSION);
+	writeValue<uint32_t>(recording, renderer::getNoOfLights());
+	noOfRecordedFrames = 0;
+	std::cout << "Recording to " << recordingPath << std::endl;
+	return true;
+}
+
+void stopRecording() {
+	recording.close();
+	std::cout << "Recorded " << noOfRecordedFrames << " frames to " << recordingPath << std::endl;
+}
+}
+
+bool Recorder::init(INIReader config) {
+	recordingPath = config.Get("recorder", "path", "capture.rec");
+	if (config.GetBoolean("recorder", "recordOnStart", false))
+		return startRecording();
+	return true;
+}
+
+void Recorder::processSDLEvent(SDL_Event event) {
+	if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F9) {
+		if (recording.is_open())
+			stopRecording();
+		else
+			startRecording();
+	}
+}
+
+void Recorder::capture(float deltaTime, float modelTime) {
+	if (!recording.is_open())
+		return;
+	glm::vec3 position;
+	float yaw, pitch;
+	Camera::getPose(position, yaw, pitch);
+	writeValue(recording, deltaTime);
+	writeValue(recording, modelTime);
+	writeValue(recording, position);
+	writeValue(recording, yaw);
+	writeValue(recording, pitch);
+	writeValue<uint32_t>(recording, renderer::getToggles());
+	writeValue<int32_t>(recording, renderer::getDebugVPL());
+	for (unsigned int i = 0; i < renderer::getNoOfLights(); ++i)
+		writeValue(recording, renderer::getLightPosition(i));
+	noOfRecordedFrames++;
+}
+
+bool Recorder::load(const std::string& path, std::vector<Frame>& frames) {
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open recording " << path << std::endl;
+		return false;
+	}
+	char magic[4];
+	uint32_t version, noOfLights;
+	if (!file.read(magic, 4) || std::memcmp(magic, RECORDING_MAGIC, 4) != 0 || !readValue(file, version) || version != RECORDING_VERSION || !readValue(file, noOfLights)) {
+		std::cerr << "Recording " << path << " is not a version " << RECORDING_VERSION << " capture" << std::endl;
+		return false;
+	}
+	if (noOfLights != renderer::getNoOfLights()) {
+		std::cerr << "Recording " << path << " was captured with " << noOfLights << " lights" << std::endl;
+		return false;
+	}
+
+	frames.clear();
+	Frame frame;
+	frame.lights.resize(noOfLights);
+	uint32_t toggles;
+	int32_t debugVPL;
+	while (readValue(file, frame.deltaTime)) {
+		bool complete = readValue(file, frame.modelTime) && readValue(file, frame.position) && readValue(file, frame.yaw) && readValue(file, frame.pitch) && readValue(file, toggles) && readValue(file, debugVPL);
+		for (unsigned int i = 0; i < noOfLights && complete; ++i)
+			complete = readValue(file, frame.lights[i]);
+		if (!complete) {
+			std::cerr << "Recording " << path << " ends with a truncated frame, ignoring it" << std::endl;
+			break;
+		}
+		frame.toggles = toggles;
+		frame.debugVPL = debugVPL;
+		frames.push_back(frame);
+	}
+	return true;
+}
+
+void Recorder::apply(const Frame& frame) {
+	Camera::setPose(frame.position, frame.yaw, frame.pitch);
+	Model::setTime(frame.modelTime);
+	renderer::setToggles(frame.toggles);
+	renderer::setDebugVPL(frame.debugVPL);
+	for (unsigned int i = 0; i < frame.lights.size(); ++i)
+		renderer::setLightPosition(i, frame.lights[i]);
+}
+
+void Recorder::destroy() {
+	if (recording.is_open())
+		stopRecording();
+}
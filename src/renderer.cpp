@@ -4,15 +4,28 @@
 #include <GL/glxew.h>
 #include <stdlib.h>
 #include <cmath>
+#include <algorithm>
 #include <CL/cl.h>
 #include <CL/cl_gl.h>
+#include <CL/cl_gl_ext.h>
 #include <sstream>
+#include <cstring>
 
 #include "model.h"
 #include "renderer.h"
 #include "camera.h"
 #include "interface.h"
-#include "halton.hpp"
+#include "light.h"
+#include "lighttree.h"
+#include "bvh.h"
+#include "ism.h"
+#include "profiler.h"
+#include "vpl.h"
+#include "resources.h"
+#include "hud.h"
+#include "scene.h"
+#include "vplworker.h"
+#include "budget.h"
 
 #define LOG_MESSAGE_LENGTH 512
 
@@ -23,26 +36,9 @@ glm::mat4 projection;
 glm::mat4 invPrevView;
 glm::mat4 invPrevProjection;
 
-struct Light {
-	glm::vec4 position;
-	glm::vec4 diffuse;
-	glm::vec4 specular;
-	glm::vec4 normal;
-};
-
-struct LightExtra {
-	unsigned int type;
-	glm::vec2 quad;
-	float angle;
-	unsigned int fbo;
-	unsigned int map;
-	glm::mat4 projection;
-};
-
 std::vector<Light> pls;
 std::vector<LightExtra> plexs;
 std::vector<Light> vpls;
-std::vector<bool> validVPLs;
 
 unsigned int p_width;
 unsigned int p_height;
@@ -64,7 +60,6 @@ unsigned int gBuffer, gPosition, gNormal, gAlbedo, gSpecular, gBufferShader;
 unsigned int dPlaneVAO, dPlaneVBO, dPlaneShader;
 
 unsigned int noOfVPLS;
-unsigned int maxVPLGenPerFrame;
 unsigned int vMasks;
 unsigned int iPlaneShader;
 
@@ -78,10 +73,60 @@ cl_mem clIsects;
 cl_mem clOcclus;
 cl_mem clVPLs;
 cl_mem clMasks;
+cl_mem clRayCounters;
 cl_program clProgram;
 cl_kernel clInitMasksKernel;
 cl_kernel clPreRaysKernel;
 cl_kernel clPostRaysKernel;
+cl_kernel clSharedOriginKernel;
+cl_kernel clTileDiscontinuityKernel;
+cl_kernel clTileRaysKernel;
+
+//Frames in flight, each slot holds what a frame left behind until the GPU is done with it
+#define MAX_FRAMES_IN_FLIGHT 4
+unsigned int framesInFlight;
+unsigned int frameSlot = 0;
+GLsync frameFences[MAX_FRAMES_IN_FLIGHT] = {};
+GLsync gBufferFences[MAX_FRAMES_IN_FLIGHT] = {};
+cl_event rayCounterEvents[MAX_FRAMES_IN_FLIGHT] = {};
+int rayCounterReadbacks[MAX_FRAMES_IN_FLIGHT][2];
+float rayCandidates[MAX_FRAMES_IN_FLIGHT];
+cl_event vplWriteEvent = NULL;
+bool syncInterop;
+clCreateEventFromGLsyncKHR_fn clCreateEventFromGLsync;
+
+//Pipelined indirect traces into one set of masks and G-buffer snapshots while the other set, traced last frame, is shaded
+bool pipelinedIndirect;
+bool pipelinePrimed = false;
+unsigned int vMasksBack;
+unsigned int snapPosition, snapNormal, snapPositionBack, snapNormalBack;
+cl_mem clMasksBack;
+cl_mem clPositionsBack, clNormalsBack;
+std::vector<Light> traceVPLs, shadeVPLs;
+glm::mat4 traceView, shadeView;
+cl_event traceEvent = NULL;
+cl_event shadeEvent = NULL;
+
+//Incremental masks keep each slice's visibility compactly per pixel along with the surface point it was traced for,
+//a slice reads the copy it wrote last time round and writes the other one so reprojected reads never race the writes
+bool incrementalMasks;
+float maskCacheThreshold;
+cl_mem clMaskCache[2];
+cl_mem clMaskCachePositions[2];
+cl_mem clVPLStamps;
+std::vector<unsigned int> vplStamps;
+std::vector<unsigned int> sliceFrames;
+std::vector<float> sliceTimes;
+std::vector<glm::mat4> sliceViewProjections;
+std::vector<unsigned int> sliceParity;
+
+//Progressive mode averages the composited indirect light of a still view, every frame shading a freshly shot slice of VPLs
+bool progressiveEnabled;
+unsigned int progressiveVPLGenPerFrame;
+unsigned int baseVPLGenPerFrame;
+unsigned int stillFrames = 0;
+unsigned int accumulatedFrames = 0;
+unsigned int accumBuffer, accumColor;
 
 RR::Buffer* rrRays;
 RR::Buffer* rrIsects;
@@ -89,7 +134,6 @@ RR::Buffer* rrOcclus;
 
 #define MAX_NO_OF_VPLS 512
 
-RR::ray vplRays[MAX_NO_OF_VPLS];
 std::vector<RR::Intersection> vplIsects;
 std::vector<int> vplOcclus;
 RR::Buffer* vplRayBuffer;
@@ -97,9 +141,7 @@ RR::Buffer* vplIsectBuffer;
 RR::Buffer* vplOccluBuffer;
 
 unsigned int interleavedSamplingSize;
-unsigned int vplNo;
 
-float rDelta;
 
 unsigned int dBuffer1, dBuffer2, iBuffer, dColor1, dColor2, iColor;
 unsigned int discShader, discBuffer1, discBuffer2, discIndirect1, discIndirect2;
@@ -115,6 +157,7 @@ int debugVPL = -1;
 bool directEnabled = true;
 bool indirectEnabled = true;
 bool vplDebugEnabled = false;
+bool adaptiveDebugEnabled = false;
 bool vplUpdated = true;
 
 std::vector<glm::mat4> viewHistory;
@@ -124,9 +167,10 @@ int iHistoryIndex;
 float lightRadius;
 float areaLightChance;
 
-int currVPL;
 int pastVPL = -1;
 int noOfInvalidVPLs;
+unsigned int vplGeneration;
+unsigned int framesSinceIndirect = 0;
 int noOfVPLBounces;
 
 bool isSpotLight = false;
@@ -137,17 +181,87 @@ unsigned int noOfLights;
 unsigned int iWidth;
 unsigned int iHeight;
 
-float vplIntersectionIA = 0;
-float vplShootingIA = 0;
-float directShadowIA = 0;
-float gBufferIA = 0;
-float directColorIA = 0;
-float indirectIntersectionIA = 0;
-float indirectColorIA = 0;
-float indirectDiscontinuityIA = 0;
-float indirectReprojectionIA = 0;
-float intervalStart = 0;
-float intervalEnd = 0;
+bool referenceEnabled;
+
+bool lightcutEnabled;
+float lightcutError;
+unsigned int lightcutMaxCut;
+float lightcutNormalWeight;
+unsigned int lightTreeLeaves;
+std::vector<LightTree::Node> lightTreeNodes;
+std::vector<unsigned int> lightTreeIndices;
+std::vector<float> lightTreePathDists;
+unsigned int lightTreeBuffer, lightTreeTexture;
+cl_mem clLightTree;
+
+bool cullingEnabled;
+float cullThreshold;
+bool rayStatsEnabled;
+float indirectRayCandidatesIA = 0;
+float indirectRaysTracedIA = 0;
+float indirectRaysOccludedIA = 0;
+
+#define VISIBILITY_RADEONRAYS 0
+#define VISIBILITY_SHARED_ORIGIN 1
+#define VISIBILITY_ISM 2
+#define SHARED_ORIGIN_PACKET_WIDTH 8
+
+unsigned int visibilityBackend;
+std::vector<glm::vec4> sceneTriangles;
+std::vector<glm::vec4> bvhTriangles;
+std::vector<unsigned int> bvhOrder;
+std::vector<BVH::Node> bvhNodes;
+cl_mem clBVHNodes = NULL;
+cl_mem clBVHTriangles = NULL;
+
+#define TILE_SAMPLES 5
+
+bool adaptiveEnabled;
+unsigned int adaptiveTileSize;
+float adaptiveDepthThreshold;
+float adaptiveNormalThreshold;
+unsigned int tilesX;
+unsigned int tilesY;
+cl_mem clTileRays;
+cl_mem clTileOcclus;
+cl_mem clTileDisc;
+RR::Buffer* rrTileRays;
+RR::Buffer* rrTileOcclus;
+float indirectTileRaysIA = 0;
+
+unsigned int ismShader, ismVAO, ismFBO, ismAtlas;
+unsigned int ismPointBuffer, ismPointTexture, ismVPLBuffer, ismVPLTexture;
+unsigned int ismSize;
+unsigned int ismTilesPerRow;
+unsigned int ismPointsPerMap;
+unsigned int ismPointSets;
+float ismPointSize;
+float ismFarPlane;
+float ismBias;
+std::vector<ISM::Sample> ismSamples;
+std::vector<glm::vec4> ismPoints;
+
+unsigned int vplIntersectionStage;
+unsigned int vplShootingStage;
+unsigned int directShadowStage;
+unsigned int gBufferStage;
+unsigned int directColorStage;
+unsigned int lightTreeStage;
+unsigned int indirectIntersectionStage;
+unsigned int indirectColorStage;
+unsigned int indirectDiscontinuityStage;
+unsigned int indirectReprojectionStage;
+unsigned int bvhRefitStage;
+unsigned int vplValidationRaysCounter;
+unsigned int vplValidationOccludedCounter;
+unsigned int vplShootingRaysCounter;
+unsigned int vplShootingHitsCounter;
+unsigned int indirectRaysCounter;
+unsigned int indirectOccludedCounter;
+unsigned int indirectTileRaysCounter;
+unsigned int hudStage;
+std::vector<unsigned int> hudStages;
+bool hudEnabled;
 unsigned int noOfFrames = 0;
 
 std::vector<float> discWeights;
@@ -165,6 +279,12 @@ void renderer::processSDLEvent(SDL_Event event) {
 		case SDLK_3:
 			vplDebugEnabled = !vplDebugEnabled;
 			break;
+		case SDLK_4:
+			adaptiveDebugEnabled = !adaptiveDebugEnabled;
+			break;
+		case SDLK_5:
+			hudEnabled = !hudEnabled;
+			break;
 		case SDLK_i:
 			i = true;
 			break;
@@ -292,6 +412,20 @@ unsigned int initShader(const char* vertexPath, const char* fragmentPath, const
 	return id;
 }
 
+unsigned int createSnapshot(const std::string& name) {
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	Resources::addTexture("Pipeline", name, GL_RGBA16F, p_width, p_height, 1);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, p_width, p_height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
 bool renderer::init(INIReader config) {
 	GLenum glewError = glewInit();
 	if (glewError != GLEW_OK) {
@@ -314,8 +448,21 @@ bool renderer::init(INIReader config) {
 
 	clContext = clCreateContext(props, 1, devices, NULL, NULL, &clErr);
 	//std::cout << clErr << std::endl;
-	clQueue = clCreateCommandQueueWithProperties(clContext, devices[0], NULL, NULL);
+	cl_queue_properties queueProps[] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+	clQueue = clCreateCommandQueueWithProperties(clContext, devices[0], queueProps, NULL);
 	intersectionApi = RR::CreateFromOpenClContext(clContext, devices[0], clQueue);
+	Resources::init(config, devices[0]);
+
+	//Without cl_khr_gl_event and GL_ARB_cl_event the two APIs can only be ordered by blocking the CPU
+	framesInFlight = std::min(std::max((int)config.GetInteger("renderer", "framesInFlight", 2), 1), MAX_FRAMES_IN_FLIGHT);
+	size_t extensionsSize = 0;
+	clGetDeviceInfo(devices[0], CL_DEVICE_EXTENSIONS, 0, NULL, &extensionsSize);
+	std::string extensions(extensionsSize, '\0');
+	clGetDeviceInfo(devices[0], CL_DEVICE_EXTENSIONS, extensionsSize, &extensions[0], NULL);
+	clCreateEventFromGLsync = (clCreateEventFromGLsyncKHR_fn)clGetExtensionFunctionAddressForPlatform(platforms[0], "clCreateEventFromGLsyncKHR");
+	syncInterop = config.GetBoolean("renderer", "syncInterop", true) && extensions.find("cl_khr_gl_event") != std::string::npos && clCreateEventFromGLsync && GLEW_ARB_cl_event;
+	if (!syncInterop)
+		std::cout << "GL/CL sync objects unavailable, falling back to glFinish/clFinish" << std::endl;
 	intersectionApi->SetOption("bvh.type", "hlbvh");
 	intersectionApi->SetOption("bvh.force2level", 1);
 
@@ -333,33 +480,45 @@ bool renderer::init(INIReader config) {
 	dpth_far_plane = config.GetReal("renderer", "depth_far_plane", 10);
 	dpth_trnsfrms.reserve(6);
 
+	if (Scene::isEnabled(config)) {
+		Scene::generateLights(config, pls, plexs);
+	}
+	else {
+		for (int i = 0; i < noOfLights; ++i) {
+			Light pl;
+			pl.position = glm::vec4(0, 0, 0, 1);
+			pl.position.x = config.GetReal("renderer", ("LightX" + std::to_string(i)).c_str(), 1);
+			pl.position.y = config.GetReal("renderer", ("LightY" + std::to_string(i)).c_str(), 1);
+			pl.position.z = config.GetReal("renderer", ("LightZ" + std::to_string(i)).c_str(), 1);
+			pl.diffuse = glm::vec4(0, 0, 0, 1);
+			pl.diffuse.r = config.GetReal("renderer", ("LightR" + std::to_string(i)).c_str(), 1);
+			pl.diffuse.g = config.GetReal("renderer", ("LightG" + std::to_string(i)).c_str(), 1);
+			pl.diffuse.b = config.GetReal("renderer", ("LightB" + std::to_string(i)).c_str(), 1);
+			pl.specular = pl.diffuse;
+			pl.normal = glm::vec4(0, 0, 0, 0);
+			pl.normal.r = config.GetReal("renderer", ("LightDX" + std::to_string(i)).c_str(), 0);
+			pl.normal.g = config.GetReal("renderer", ("LightDY" + std::to_string(i)).c_str(), 1);
+			pl.normal.b = config.GetReal("renderer", ("LightDZ" + std::to_string(i)).c_str(), 0);
+			pls.push_back(pl);
+
+			LightExtra plex;
+			plex.type = config.GetInteger("renderer", ("LightType" + std::to_string(i)).c_str(), 0);
+			plex.quad.x = config.GetReal("renderer", ("LightQuadX" + std::to_string(i)).c_str(), 1);
+			plex.quad.y = config.GetReal("renderer", ("LightQuadY" + std::to_string(i)).c_str(), 1);
+			plex.angle = config.GetReal("renderer", ("LightAngle" + std::to_string(i)).c_str(), 1);
+			plexs.push_back(plex);
+		}
+	}
+	noOfLights = pls.size();
+
 	for (int i = 0; i < noOfLights; ++i) {
-		Light pl;
-		pl.position = glm::vec4(0, 0, 0, 1);
-		pl.position.x = config.GetReal("renderer", ("LightX" + std::to_string(i)).c_str(), 1);
-		pl.position.y = config.GetReal("renderer", ("LightY" + std::to_string(i)).c_str(), 1);
-		pl.position.z = config.GetReal("renderer", ("LightZ" + std::to_string(i)).c_str(), 1);
-		pl.diffuse = glm::vec4(0, 0, 0, 1);
-		pl.diffuse.r = config.GetReal("renderer", ("LightR" + std::to_string(i)).c_str(), 1);
-		pl.diffuse.g = config.GetReal("renderer", ("LightG" + std::to_string(i)).c_str(), 1);
-		pl.diffuse.b = config.GetReal("renderer", ("LightB" + std::to_string(i)).c_str(), 1);
-		pl.specular = pl.diffuse;
-		pl.normal = glm::vec4(0, 0, 0, 0);
-		pl.normal.r = config.GetReal("renderer", ("LightDX" + std::to_string(i)).c_str(), 0);
-		pl.normal.g = config.GetReal("renderer", ("LightDY" + std::to_string(i)).c_str(), 1);
-		pl.normal.b = config.GetReal("renderer", ("LightDZ" + std::to_string(i)).c_str(), 0);
-		pls.push_back(pl);
-
-		LightExtra plex;
-		plex.type = config.GetInteger("renderer", ("LightType" + std::to_string(i)).c_str(), 0);
-		plex.quad.x = config.GetReal("renderer", ("LightQuadX" + std::to_string(i)).c_str(), 1);
-		plex.quad.y = config.GetReal("renderer", ("LightQuadY" + std::to_string(i)).c_str(), 1);
-		plex.angle = config.GetReal("renderer", ("LightAngle" + std::to_string(i)).c_str(), 1);
+		LightExtra& plex = plexs[i];
 
 		glGenFramebuffers(1, &plex.fbo);
 		glGenTextures(1, &plex.map);
 
 		if (plex.type == 2) {
+			Resources::addTexture("Shadow maps", "light" + std::to_string(i), GL_DEPTH_COMPONENT, dpth_width, dpth_height, 1);
 			glBindTexture(GL_TEXTURE_2D, plex.map);
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, dpth_width, dpth_height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -368,6 +527,7 @@ bool renderer::init(INIReader config) {
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		}
 		else {
+			Resources::addTexture("Shadow maps", "light" + std::to_string(i), GL_DEPTH_COMPONENT, dpth_width, dpth_height, 6);
 			glBindTexture(GL_TEXTURE_CUBE_MAP, plex.map);
 			for (unsigned int i = 0; i < 6; ++i)
 				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, dpth_width, dpth_height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
@@ -382,8 +542,6 @@ bool renderer::init(INIReader config) {
 		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, plex.map, 0);
 		glDrawBuffer(GL_NONE);
 		glReadBuffer(GL_NONE);
-
-		plexs.push_back(plex);
 	}
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -404,6 +562,7 @@ bool renderer::init(INIReader config) {
 	glGenFramebuffers(1, &gBuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
 	glGenTextures(1, &gPosition);
+	Resources::addTexture("G-buffer", "gPosition", GL_RGBA16F, p_width, p_height, 1);
 	glBindTexture(GL_TEXTURE_2D, gPosition); //MUST BE RGBA FOR OPENCL INTEROP
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, p_width, p_height, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -413,8 +572,9 @@ bool renderer::init(INIReader config) {
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
 
 	glGenTextures(1, &gNormal);
-	glBindTexture(GL_TEXTURE_2D, gNormal);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, p_width, p_height, 0, GL_RGB, GL_FLOAT, NULL);
+	Resources::addTexture("G-buffer", "gNormal", GL_RGBA16F, p_width, p_height, 1);
+	glBindTexture(GL_TEXTURE_2D, gNormal); //MUST BE RGBA FOR OPENCL INTEROP
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, p_width, p_height, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -422,6 +582,7 @@ bool renderer::init(INIReader config) {
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
 
 	glGenTextures(1, &gAlbedo);
+	Resources::addTexture("G-buffer", "gAlbedo", GL_RGB16F, p_width, p_height, 1);
 	glBindTexture(GL_TEXTURE_2D, gAlbedo);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, p_width, p_height, 0, GL_RGB, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -431,6 +592,7 @@ bool renderer::init(INIReader config) {
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedo, 0);
 
 	glGenTextures(1, &gSpecular);
+	Resources::addTexture("G-buffer", "gSpecular", GL_RGB16F, p_width, p_height, 1);
 	glBindTexture(GL_TEXTURE_2D, gSpecular);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, p_width, p_height, 0, GL_RGB, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -444,6 +606,7 @@ bool renderer::init(INIReader config) {
 
 	unsigned int rboDepth;
 	glGenRenderbuffers(1, &rboDepth);
+	Resources::addRenderbuffer("G-buffer", "rboDepth", GL_DEPTH_COMPONENT, p_width, p_height);
 	glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, p_width, p_height);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
@@ -479,6 +642,7 @@ bool renderer::init(INIReader config) {
 	glGenBuffers(1, &dPlaneVBO);
 	glGenVertexArrays(1, &dPlaneVAO);
 	glBindVertexArray(dPlaneVAO);
+	Resources::addBuffer("Screen quad", "dPlaneVBO", "GL buffer", sizeof(vertices));
 	glBindBuffer(GL_ARRAY_BUFFER, dPlaneVBO);
 	glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(GL_FLOAT), vertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
@@ -503,7 +667,10 @@ bool renderer::init(INIReader config) {
 		std::cerr << "Failed to initialise Discontinuity shader" << std::endl;
 		return false;
 	}
-	unsigned int discSize = config.GetInteger("renderer", "discSize", 1);
+	//The reference shades every VPL at every pixel each frame, with no history, interleaving or blur
+	referenceEnabled = config.GetBoolean("renderer", "reference", false);
+
+	unsigned int discSize = referenceEnabled ? 1 : config.GetInteger("renderer", "discSize", 1);
 	float stdev = config.GetReal("renderer", "discStdev", 1);
 	float totalWeight = 0;
 	for (int i = 0; i < discSize; ++i) {
@@ -530,13 +697,13 @@ bool renderer::init(INIReader config) {
 	file.close();
 
 	noOfVPLS = config.GetInteger("renderer", "noOfVPLs", 1);
-	maxVPLGenPerFrame = config.GetInteger("renderer", "maxVPLGenPerFrame", 5);
-	interleavedSamplingSize = config.GetInteger("renderer", "interleavedSamplingSize", 5);
+	interleavedSamplingSize = referenceEnabled ? 1 : config.GetInteger("renderer", "interleavedSamplingSize", 5);
 
-	iWidth = config.GetInteger("renderer", "indirectBufferWidth", 1);
-	iHeight = config.GetInteger("renderer", "indirectBufferHeight", 1);
+	iWidth = referenceEnabled ? p_width : config.GetInteger("renderer", "indirectBufferWidth", 1);
+	iHeight = referenceEnabled ? p_height : config.GetInteger("renderer", "indirectBufferHeight", 1);
 
 	glGenTextures(1, &vMasks);
+	Resources::addTexture("Masks", "vMasks", GL_RGBA8, iWidth, iHeight, noOfVPLS);
 	glBindTexture(GL_TEXTURE_2D_ARRAY, vMasks);
 	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, iWidth, iHeight, noOfVPLS, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -544,6 +711,7 @@ bool renderer::init(INIReader config) {
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	Resources::add("Masks", "clMasks", "CL image", "shares vMasks", 0);
 	clMasks = clCreateFromGLTexture(clContext, CL_MEM_READ_WRITE, GL_TEXTURE_2D_ARRAY, 0, vMasks, NULL);
 	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
@@ -555,14 +723,25 @@ bool renderer::init(INIReader config) {
 	clPreRaysKernel = clCreateKernel(clProgram, "pre_rays", &preErr);
 	cl_int postErr;
 	clPostRaysKernel = clCreateKernel(clProgram, "post_rays", &postErr);
-	if (initErr != 0 || preErr != 0 || postErr != 0) {
+	cl_int sharedOriginErr;
+	clSharedOriginKernel = clCreateKernel(clProgram, "shared_origin_occlusion", &sharedOriginErr);
+	cl_int tileDiscErr;
+	clTileDiscontinuityKernel = clCreateKernel(clProgram, "tile_discontinuity", &tileDiscErr);
+	cl_int tileRaysErr;
+	clTileRaysKernel = clCreateKernel(clProgram, "tile_rays", &tileRaysErr);
+	if (initErr != 0 || preErr != 0 || postErr != 0 || sharedOriginErr != 0 || tileDiscErr != 0 || tileRaysErr != 0) {
 		char buildLog[LOG_MESSAGE_LENGTH];
 		clGetProgramBuildInfo(clProgram, devices[0], CL_PROGRAM_BUILD_LOG, LOG_MESSAGE_LENGTH, buildLog, NULL);
 		std::cerr << "Failed to build OpenCL Kernel : " << std::endl << buildLog << std::endl;
 		return false;
 	}
+	Resources::add("G-buffer", "clPositions", "CL image", "shares gPosition", 0);
+	Resources::add("G-buffer", "clNormals", "CL image", "shares gNormal", 0);
+	Resources::addBuffer("Rays", "clRays", "CL buffer", (size_t)noOfVPLS * iWidth * iHeight * sizeof(RR::ray));
+	Resources::addBuffer("VPLs", "clVPLs", "CL buffer", noOfVPLS * sizeof(Light));
+	Resources::addBuffer("Rays", "clOcclus", "CL buffer", (size_t)noOfVPLS * iWidth * iHeight * sizeof(int));
 	clPositions = clCreateFromGLTexture(clContext, CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0, gPosition, &clErr);
-	//clNormals = clCreateFromGLTexture(clContext, CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, gNormal, &clErr);
+	clNormals = clCreateFromGLTexture(clContext, CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, gNormal, &clErr);
 	//clSpeculars = clCreateFromGLTexture(clContext, CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, gSpecular, &clErr);
 	clRays = clCreateBuffer(clContext, CL_MEM_READ_WRITE, noOfVPLS * iWidth * iHeight * sizeof(RR::ray), NULL, NULL);
 	clVPLs = clCreateBuffer(clContext, CL_MEM_READ_WRITE, noOfVPLS * sizeof(Light), NULL, NULL);
@@ -573,26 +752,25 @@ bool renderer::init(INIReader config) {
 	//rrIsects = RR::CreateFromOpenClBuffer(intersectionApi, clIsects);
 	rrOcclus = RR::CreateFromOpenClBuffer(intersectionApi, clOcclus);
 
-	rDelta = config.GetReal("renderer", "rDelta", 0.1f);
-	for (int i = 0; i < noOfVPLS; ++i) {
+	for (int i = 0; i < noOfVPLS; ++i)
 		vpls.push_back(pls[0]);
-		validVPLs.push_back(false);
-	}
 	noOfInvalidVPLs = noOfVPLS;
+	vplGeneration = 0;
 
-	//vplRays.reserve(noOfVPLS);
 	vplIsects.reserve(noOfVPLS);
 	vplOcclus.reserve(noOfVPLS);
+	Resources::addBuffer("VPLs", "vplRayBuffer", "RR buffer", noOfVPLS * sizeof(RR::ray));
+	Resources::addBuffer("VPLs", "vplIsectBuffer", "RR buffer", noOfVPLS * sizeof(RR::Intersection));
+	Resources::addBuffer("VPLs", "vplOccluBuffer", "RR buffer", noOfVPLS * sizeof(int));
 	vplRayBuffer = intersectionApi->CreateBuffer(noOfVPLS * sizeof(RR::ray), nullptr);
 	vplIsectBuffer = intersectionApi->CreateBuffer(noOfVPLS * sizeof(RR::Intersection), nullptr);
 	vplOccluBuffer = intersectionApi->CreateBuffer(noOfVPLS * sizeof(int), nullptr);
 
-	vplNo = 0;
-	currVPL = 0;
 
 	glGenFramebuffers(1, &dBuffer1);
 	glBindFramebuffer(GL_FRAMEBUFFER, dBuffer1);
 	glGenTextures(1, &dColor1);
+	Resources::addTexture("Composite", "dColor1", GL_RGB16F, p_width, p_height, 1);
 	glBindTexture(GL_TEXTURE_2D, dColor1);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, p_width, p_height, 0, GL_RGB, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -607,6 +785,7 @@ bool renderer::init(INIReader config) {
 	glGenFramebuffers(1, &dBuffer2);
 	glBindFramebuffer(GL_FRAMEBUFFER, dBuffer2);
 	glGenTextures(1, &dColor2);
+	Resources::addTexture("Composite", "dColor2", GL_RGB16F, p_width, p_height, 1);
 	glBindTexture(GL_TEXTURE_2D, dColor2);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, p_width, p_height, 0, GL_RGB, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -618,6 +797,7 @@ bool renderer::init(INIReader config) {
 	glGenFramebuffers(1, &iBuffer);
 	glBindFramebuffer(GL_FRAMEBUFFER, iBuffer);
 	glGenTextures(1, &iColor);
+	Resources::addTexture("Indirect", "iColor", GL_RGB16F, iWidth, iHeight, 1);
 	glBindTexture(GL_TEXTURE_2D, iColor);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, iWidth, iHeight, 0, GL_RGB, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -632,6 +812,7 @@ bool renderer::init(INIReader config) {
 	glBindFramebuffer(GL_FRAMEBUFFER, discBuffer1);
 
 	glGenTextures(1, &discIndirect1);
+	Resources::addTexture("Indirect", "discIndirect1", GL_RGB16F, iWidth, iHeight, 1);
 	glBindTexture(GL_TEXTURE_2D, discIndirect1);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, iWidth, iHeight, 0, GL_RGB, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -646,6 +827,7 @@ bool renderer::init(INIReader config) {
 	glBindFramebuffer(GL_FRAMEBUFFER, discBuffer2);
 
 	glGenTextures(1, &discIndirect2);
+	Resources::addTexture("Indirect", "discIndirect2", GL_RGB16F, iWidth, iHeight, 1);
 	glBindTexture(GL_TEXTURE_2D, discIndirect2);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, iWidth, iHeight, 0, GL_RGB, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -662,9 +844,10 @@ bool renderer::init(INIReader config) {
 	lightSpeed = config.GetReal("renderer", "lightSpeed", 1.f);
 
 	iHistoryIndex = 0;
-	iHistorySize = config.GetInteger("renderer", "iHistorySize", 1);
+	iHistorySize = referenceEnabled ? 1 : config.GetInteger("renderer", "iHistorySize", 1);
 	viewHistory.reserve(iHistorySize);
 	glGenTextures(1, &iHistory);
+	Resources::addTexture("History", "iHistory", GL_RGB16F, iWidth, iHeight, iHistorySize);
 	glBindTexture(GL_TEXTURE_2D_ARRAY, iHistory);
 	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB16F, iWidth, iHeight, iHistorySize, 0, GL_RGB, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -673,6 +856,7 @@ bool renderer::init(INIReader config) {
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glGenTextures(1, &pHistory);
+	Resources::addTexture("History", "pHistory", GL_RGBA16F, p_width, p_height, iHistorySize);
 	glBindTexture(GL_TEXTURE_2D_ARRAY, pHistory);
 	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA16F, p_width, p_height, iHistorySize, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -697,28 +881,398 @@ bool renderer::init(INIReader config) {
 	lightRadius = config.GetReal("renderer", "LightRadius", 0.1f);
 	noOfVPLBounces = config.GetInteger("renderer", "noOfVPLBounces", 0.1f);
 
+	//The threaded worker builds its own intersection api, reference renders stay on the render thread
+	bool vplThread = !referenceEnabled && config.GetBoolean("renderer", "vplThread", false);
+	if (!VPLWorker::init(config, clContext, devices[0], intersectionApi, pls, noOfVPLS, noOfVPLBounces, iHistorySize, vplThread))
+		return false;
+	if (!Budget::init(config, VPLWorker::getMaxGenPerFrame(), !referenceEnabled))
+		return false;
+
+	progressiveEnabled = !referenceEnabled && config.GetBoolean("renderer", "progressive", false);
+	baseVPLGenPerFrame = VPLWorker::getMaxGenPerFrame();
+	progressiveVPLGenPerFrame = config.GetInteger("renderer", "progressiveVPLGenPerFrame", noOfVPLS / iHistorySize);
+	if (progressiveEnabled) {
+		glGenFramebuffers(1, &accumBuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, accumBuffer);
+		glGenTextures(1, &accumColor);
+		Resources::addTexture("Progressive", "accumColor", GL_RGBA32F, p_width, p_height, 1);
+		glBindTexture(GL_TEXTURE_2D, accumColor);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, p_width, p_height, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumColor, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "Progressive accumulation framebuffer not complete." << std::endl;
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return false;
+		}
+		static const float zero[4] = { 0, 0, 0, 0 };
+		glClearBufferfv(GL_COLOR, 0, zero);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	lightcutEnabled = !referenceEnabled && config.GetBoolean("renderer", "lightcutEnabled", false);
+	lightcutError = config.GetReal("renderer", "lightcutError", 0.02f);
+	lightcutMaxCut = config.GetInteger("renderer", "lightcutMaxCut", 32);
+	lightcutNormalWeight = config.GetReal("renderer", "lightcutNormalWeight", 1.f);
+	lightTreeLeaves = noOfVPLS / (interleavedSamplingSize * interleavedSamplingSize * iHistorySize);
+	if (lightcutEnabled && lightTreeLeaves == 0) {
+		std::cerr << "Lightcuts need at least one VPL per interleaved cell, disabling" << std::endl;
+		lightcutEnabled = false;
+	}
+	lightTreeIndices.resize(lightTreeLeaves);
+	lightTreePathDists.resize(lightTreeLeaves);
+	unsigned int lightTreeBytes = interleavedSamplingSize * interleavedSamplingSize * glm::max(LightTree::getTreeSize(lightTreeLeaves), 1u) * sizeof(LightTree::Node);
+	lightTreeNodes.reserve(lightTreeBytes / sizeof(LightTree::Node));
+	Resources::addBuffer("Light tree", "lightTreeBuffer", "GL buffer", lightTreeBytes);
+	Resources::addBuffer("Light tree", "clLightTree", "CL buffer", lightTreeBytes);
+	glGenBuffers(1, &lightTreeBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, lightTreeBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, lightTreeBytes, NULL, GL_DYNAMIC_DRAW);
+	glGenTextures(1, &lightTreeTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, lightTreeTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightTreeBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	clLightTree = clCreateBuffer(clContext, CL_MEM_READ_ONLY, lightTreeBytes, NULL, NULL);
+
+	cullingEnabled = !referenceEnabled && config.GetBoolean("renderer", "cullingEnabled", true);
+	cullThreshold = config.GetReal("renderer", "cullThreshold", 0.f);
+	rayStatsEnabled = config.GetBoolean("renderer", "rayStatistics", false);
+	Resources::addBuffer("Statistics", "clRayCounters", "CL buffer", 2 * sizeof(int));
+	clRayCounters = clCreateBuffer(clContext, CL_MEM_READ_WRITE, 2 * sizeof(int), NULL, NULL);
+
+	std::string backend = referenceEnabled ? "radeonrays" : config.Get("renderer", "visibilityBackend", "radeonrays");
+	if (backend == "shared_origin")
+		visibilityBackend = VISIBILITY_SHARED_ORIGIN;
+	else if (backend == "ism")
+		visibilityBackend = VISIBILITY_ISM;
+	else if (backend == "radeonrays")
+		visibilityBackend = VISIBILITY_RADEONRAYS;
+	else {
+		std::cerr << "Unknown visibility backend " << backend << ", using radeonrays" << std::endl;
+		visibilityBackend = VISIBILITY_RADEONRAYS;
+	}
+
+	if (visibilityBackend == VISIBILITY_ISM && noOfVPLS / (interleavedSamplingSize * interleavedSamplingSize * iHistorySize) == 0) {
+		std::cerr << "Imperfect shadow maps need at least one VPL per interleaved cell, using radeonrays" << std::endl;
+		visibilityBackend = VISIBILITY_RADEONRAYS;
+	}
+	if (visibilityBackend == VISIBILITY_ISM) {
+		if (lightcutEnabled) {
+			std::cerr << "Lightcuts are not supported by the ism backend, disabling" << std::endl;
+			lightcutEnabled = false;
+		}
+
+		ismSize = config.GetInteger("renderer", "ismSize", 64);
+		ismPointsPerMap = config.GetInteger("renderer", "ismPointsPerMap", 4096);
+		ismPointSets = glm::max((int)config.GetInteger("renderer", "ismPointSets", 16), 1);
+		ismPointSize = config.GetReal("renderer", "ismPointSize", 2.f);
+		ismFarPlane = config.GetReal("renderer", "ismFarPlane", dpth_far_plane);
+		ismBias = config.GetReal("renderer", "ismBias", 0.005f);
+		ismTilesPerRow = ISM::getTilesPerRow(noOfVPLS / iHistorySize);
+
+		ismShader = initShader("src/shaders/ism.vsh", "src/shaders/ism.fsh");
+		if (ismShader == 0) {
+			std::cerr << "Failed to initialise ISM shader" << std::endl;
+			return false;
+		}
+		glGenVertexArrays(1, &ismVAO);
+
+		glGenBuffers(1, &ismPointBuffer);
+		glGenTextures(1, &ismPointTexture);
+		glBindBuffer(GL_TEXTURE_BUFFER, ismPointBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, ismPointTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, ismPointBuffer);
+		glGenBuffers(1, &ismVPLBuffer);
+		glGenTextures(1, &ismVPLTexture);
+		Resources::addBuffer("ISM", "ismVPLBuffer", "GL buffer", noOfVPLS * sizeof(Light));
+		glBindBuffer(GL_TEXTURE_BUFFER, ismVPLBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, noOfVPLS * sizeof(Light), NULL, GL_DYNAMIC_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, ismVPLTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, ismVPLBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glGenFramebuffers(1, &ismFBO);
+		glGenTextures(1, &ismAtlas);
+		Resources::addTexture("ISM", "ismAtlas", GL_DEPTH_COMPONENT32F, ismSize * ismTilesPerRow, ismSize * ismTilesPerRow, 1);
+		glBindTexture(GL_TEXTURE_2D, ismAtlas);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, ismSize * ismTilesPerRow, ismSize * ismTilesPerRow, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindFramebuffer(GL_FRAMEBUFFER, ismFBO);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ismAtlas, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "ISM framebuffer not complete." << std::endl;
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return false;
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	adaptiveEnabled = !referenceEnabled && config.GetBoolean("renderer", "adaptiveEnabled", false);
+	adaptiveTileSize = glm::max((int)config.GetInteger("renderer", "adaptiveTileSize", 16), 1);
+	adaptiveDepthThreshold = config.GetReal("renderer", "adaptiveDepthThreshold", 0.1f);
+	adaptiveNormalThreshold = config.GetReal("renderer", "adaptiveNormalThreshold", 0.9f);
+	tilesX = (iWidth + adaptiveTileSize - 1) / adaptiveTileSize;
+	tilesY = (iHeight + adaptiveTileSize - 1) / adaptiveTileSize;
+	unsigned int noOfTileRays = adaptiveEnabled ? tilesX * tilesY * (noOfVPLS / iHistorySize) * TILE_SAMPLES : 1;
+	Resources::addBuffer("Adaptive", "clTileRays", "CL buffer", noOfTileRays * sizeof(RR::ray));
+	Resources::addBuffer("Adaptive", "clTileOcclus", "CL buffer", noOfTileRays * sizeof(int));
+	Resources::addBuffer("Adaptive", "clTileDisc", "CL buffer", tilesX * tilesY * sizeof(int));
+	clTileRays = clCreateBuffer(clContext, CL_MEM_READ_WRITE, noOfTileRays * sizeof(RR::ray), NULL, NULL);
+	clTileOcclus = clCreateBuffer(clContext, CL_MEM_READ_WRITE, noOfTileRays * sizeof(int), NULL, NULL);
+	clTileDisc = clCreateBuffer(clContext, CL_MEM_READ_WRITE, tilesX * tilesY * sizeof(int), NULL, NULL);
+	rrTileRays = RR::CreateFromOpenClBuffer(intersectionApi, clTileRays);
+	rrTileOcclus = RR::CreateFromOpenClBuffer(intersectionApi, clTileOcclus);
+
+	incrementalMasks = !referenceEnabled && config.GetBoolean("renderer", "incrementalMasks", false);
+	maskCacheThreshold = config.GetReal("renderer", "maskCacheThreshold", 0.01f);
+	unsigned int cacheVPLsPerPixel = noOfVPLS / (interleavedSamplingSize * interleavedSamplingSize * iHistorySize);
+	if (incrementalMasks && (visibilityBackend != VISIBILITY_RADEONRAYS || lightcutEnabled || cacheVPLsPerPixel == 0)) {
+		std::cerr << "Incremental masks need the RadeonRays backend without lightcuts and at least one VPL per pixel, disabling" << std::endl;
+		incrementalMasks = false;
+	}
+	size_t noOfCacheMasks = incrementalMasks ? (size_t)iWidth * iHeight * iHistorySize * cacheVPLsPerPixel : 1;
+	size_t noOfCachePositions = incrementalMasks ? (size_t)iWidth * iHeight * iHistorySize : 1;
+	for (unsigned int c = 0; c < 2; ++c) {
+		Resources::addBuffer("Incremental", "clMaskCache" + std::to_string(c), "CL buffer", noOfCacheMasks * sizeof(cl_uchar2));
+		Resources::addBuffer("Incremental", "clMaskCachePositions" + std::to_string(c), "CL buffer", noOfCachePositions * sizeof(cl_float4));
+		clMaskCache[c] = clCreateBuffer(clContext, CL_MEM_READ_WRITE, noOfCacheMasks * sizeof(cl_uchar2), NULL, NULL);
+		clMaskCachePositions[c] = clCreateBuffer(clContext, CL_MEM_READ_WRITE, noOfCachePositions * sizeof(cl_float4), NULL, NULL);
+		//w = 0 marks a pixel that was never traced
+		static const cl_float4 untraced = { 0, 0, 0, 0 };
+		clEnqueueFillBuffer(clQueue, clMaskCachePositions[c], &untraced, sizeof(cl_float4), 0, noOfCachePositions * sizeof(cl_float4), 0, NULL, NULL);
+	}
+	Resources::addBuffer("Incremental", "clVPLStamps", "CL buffer", noOfVPLS * sizeof(unsigned int));
+	vplStamps.assign(noOfVPLS, 0);
+	clVPLStamps = clCreateBuffer(clContext, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, noOfVPLS * sizeof(unsigned int), vplStamps.data(), NULL);
+	sliceFrames.assign(iHistorySize, 0);
+	sliceTimes.assign(iHistorySize, 0);
+	sliceViewProjections.assign(iHistorySize, glm::mat4(1));
+	sliceParity.assign(iHistorySize, 0);
+
+	pipelinedIndirect = !referenceEnabled && config.GetBoolean("renderer", "pipelinedIndirect", false);
+	if (pipelinedIndirect && (visibilityBackend == VISIBILITY_ISM || lightcutEnabled)) {
+		std::cerr << "Pipelined indirect needs a CL visibility backend without lightcuts, disabling" << std::endl;
+		pipelinedIndirect = false;
+	}
+	if (pipelinedIndirect) {
+		snapPosition = createSnapshot("snapPosition");
+		snapNormal = createSnapshot("snapNormal");
+		snapPositionBack = createSnapshot("snapPositionBack");
+		snapNormalBack = createSnapshot("snapNormalBack");
+
+		glGenTextures(1, &vMasksBack);
+		Resources::addTexture("Pipeline", "vMasksBack", GL_RGBA8, iWidth, iHeight, noOfVPLS);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, vMasksBack);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, iWidth, iHeight, noOfVPLS, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		//The CL images share the snapshots instead, so the G-buffer is free for the next frame once it is copied
+		Resources::add("Pipeline", "clMasksBack", "CL image", "shares vMasksBack", 0);
+		Resources::add("Pipeline", "clPositionsBack", "CL image", "shares snapPositionBack", 0);
+		Resources::add("Pipeline", "clNormalsBack", "CL image", "shares snapNormalBack", 0);
+		clReleaseMemObject(clPositions);
+		clReleaseMemObject(clNormals);
+		clPositions = clCreateFromGLTexture(clContext, CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0, snapPosition, &clErr);
+		clNormals = clCreateFromGLTexture(clContext, CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, snapNormal, &clErr);
+		clPositionsBack = clCreateFromGLTexture(clContext, CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0, snapPositionBack, &clErr);
+		clNormalsBack = clCreateFromGLTexture(clContext, CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, snapNormalBack, &clErr);
+		clMasksBack = clCreateFromGLTexture(clContext, CL_MEM_READ_WRITE, GL_TEXTURE_2D_ARRAY, 0, vMasksBack, NULL);
+
+		clEnqueueAcquireGLObjects(clQueue, 1, &clMasksBack, 0, NULL, NULL);
+		clSetKernelArg(clInitMasksKernel, 0, sizeof(cl_mem), (void*)& clMasksBack);
+		clEnqueueNDRangeKernel(clQueue, clInitMasksKernel, 3, NULL, global_item_size, local_item_size, 0, NULL, NULL);
+		clEnqueueReleaseGLObjects(clQueue, 1, &clMasksBack, 0, NULL, NULL);
+		clFinish(clQueue);
+	}
+
+	Profiler::init(clQueue, config);
+	vplIntersectionStage = Profiler::addStage("VPL Intersection Tests");
+	vplShootingStage = Profiler::addStage("VPL Shooting");
+	directShadowStage = Profiler::addStage("Direct Shadow Cubemaps");
+	gBufferStage = Profiler::addStage("G-Buffer");
+	directColorStage = Profiler::addStage("Direct Shading");
+	lightTreeStage = Profiler::addStage("Light Tree Construction");
+	indirectIntersectionStage = Profiler::addStage("Indirect Intersection Tests");
+	indirectColorStage = Profiler::addStage("Indirect Shading");
+	indirectDiscontinuityStage = Profiler::addStage("Indirect Discontinuity");
+	indirectReprojectionStage = Profiler::addStage("Indirect Reprojection");
+	bvhRefitStage = Profiler::addStage("Shared-Origin BVH Refit");
+	Profiler::enableStatistics(directShadowStage);
+	Profiler::enableStatistics(gBufferStage);
+	Profiler::enableStatistics(directColorStage);
+	Profiler::enableStatistics(indirectIntersectionStage);
+	Profiler::enableStatistics(indirectColorStage);
+	Profiler::enableStatistics(indirectDiscontinuityStage);
+	Profiler::enableStatistics(indirectReprojectionStage);
+	vplValidationRaysCounter = Profiler::addCounter("VPL Validation Rays", vplIntersectionStage);
+	vplValidationOccludedCounter = Profiler::addCounter("VPL Validation Occluded");
+	vplShootingRaysCounter = Profiler::addCounter("VPL Shooting Rays", vplShootingStage);
+	vplShootingHitsCounter = Profiler::addCounter("VPL Shooting Hits");
+	indirectRaysCounter = Profiler::addCounter("Indirect Rays", indirectIntersectionStage);
+	indirectOccludedCounter = Profiler::addCounter("Indirect Rays Occluded");
+	indirectTileRaysCounter = Profiler::addCounter("Indirect Tile Rays", indirectIntersectionStage);
+	hudStage = Profiler::addStage("HUD");
+	for (unsigned int stage = vplIntersectionStage; stage <= hudStage; ++stage)
+		hudStages.push_back(stage);
+
+	unsigned int hudShader = initShader("src/shaders/hud.vsh", "src/shaders/hud.fsh");
+	if (hudShader == 0) {
+		std::cerr << "Failed to initialise HUD shader" << std::endl;
+		return false;
+	}
+	HUD::init(config, hudShader, p_width, p_height);
+	hudEnabled = config.GetBoolean("hud", "enabled", false);
+
 	glClearColor(0.f, 0.f, 0.f, 1.0f);
 	return true;
 }
 
+unsigned int renderer::getNoOfLights() {
+	return pls.size();
+}
+
+glm::vec3 renderer::getLightPosition(unsigned int light) {
+	return glm::vec3(pls[light].position);
+}
+
+void renderer::setLightPosition(unsigned int light, glm::vec3 position) {
+	if (light < pls.size())
+		pls[light].position = glm::vec4(position, 1);
+}
+
+unsigned int renderer::getToggles() {
+	unsigned int toggles = 0;
+	if (directEnabled) toggles |= TOGGLE_DIRECT;
+	if (indirectEnabled) toggles |= TOGGLE_INDIRECT;
+	if (vplDebugEnabled) toggles |= TOGGLE_VPL_DEBUG;
+	if (adaptiveDebugEnabled) toggles |= TOGGLE_ADAPTIVE_DEBUG;
+	if (hudEnabled) toggles |= TOGGLE_HUD;
+	return toggles;
+}
+
+void renderer::setToggles(unsigned int toggles) {
+	directEnabled = toggles & TOGGLE_DIRECT;
+	indirectEnabled = toggles & TOGGLE_INDIRECT;
+	vplDebugEnabled = toggles & TOGGLE_VPL_DEBUG;
+	adaptiveDebugEnabled = toggles & TOGGLE_ADAPTIVE_DEBUG;
+	hudEnabled = toggles & TOGGLE_HUD;
+}
+
+int renderer::getDebugVPL() {
+	return debugVPL;
+}
+
+void renderer::setDebugVPL(int vpl) {
+	debugVPL = vpl;
+}
+
 RR::IntersectionApi* renderer::getIntersectionApi() {
 	return intersectionApi;
 }
 
-float getQuadLightDistance(Light pl, Light vpl) {
-	float hyp = glm::distance(pl.position, vpl.position);
-	glm::vec4 dir = glm::normalize(vpl.position - pl.position);
-	float angle = acos(glm::dot(dir, pl.normal));
-	float hypAngle = acos(glm::dot(glm::vec4(0, -1, 0, 0), pl.normal));
-	float distance;
-	if (hypAngle != 0)
-		distance = sin(angle) / sin(hypAngle) * hyp;
-	else
-		distance = cos(angle) * hyp;
-	return distance;
+//The shared-origin kernel traverses its own BVH, built once from the loaded meshes and refit while anything moves
+void updateSceneBVH() {
+	if (clBVHNodes == NULL) {
+		Model::getTriangles(sceneTriangles);
+		BVH::build(sceneTriangles, bvhNodes, bvhTriangles, bvhOrder);
+		Resources::addBuffer("BVH", "clBVHNodes", "CL buffer", glm::max(bvhNodes.size(), (size_t)1) * sizeof(BVH::Node));
+		Resources::addBuffer("BVH", "clBVHTriangles", "CL buffer", glm::max(bvhTriangles.size(), (size_t)1) * sizeof(glm::vec4));
+		clBVHNodes = clCreateBuffer(clContext, CL_MEM_READ_ONLY, glm::max(bvhNodes.size(), (size_t)1) * sizeof(BVH::Node), NULL, NULL);
+		clBVHTriangles = clCreateBuffer(clContext, CL_MEM_READ_ONLY, glm::max(bvhTriangles.size(), (size_t)1) * sizeof(glm::vec4), NULL, NULL);
+	}
+	else if (Model::hasDynamicMeshes()) {
+		Model::getTriangles(sceneTriangles);
+		BVH::refit(sceneTriangles, bvhOrder, bvhNodes, bvhTriangles);
+	}
+	else {
+		return;
+	}
+	clEnqueueWriteBuffer(clQueue, clBVHNodes, CL_FALSE, 0, bvhNodes.size() * sizeof(BVH::Node), bvhNodes.data(), 0, NULL, NULL);
+	clEnqueueWriteBuffer(clQueue, clBVHTriangles, CL_FALSE, 0, bvhTriangles.size() * sizeof(glm::vec4), bvhTriangles.data(), 0, NULL, NULL);
+}
+
+//Point samples are drawn once from the loaded meshes and re-placed on their triangles while anything moves
+void updateISMPoints() {
+	if (ismSamples.empty()) {
+		Model::getTriangles(sceneTriangles);
+		ISM::sample(sceneTriangles, ismPointsPerMap * ismPointSets, ismSamples);
+	}
+	else if (Model::hasDynamicMeshes()) {
+		Model::getTriangles(sceneTriangles);
+	}
+	else {
+		return;
+	}
+	ISM::place(sceneTriangles, ismSamples, ismPoints);
+	Resources::addBuffer("ISM", "ismPointBuffer", "GL buffer", ismPoints.size() * sizeof(glm::vec4));
+	glBindBuffer(GL_TEXTURE_BUFFER, ismPointBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, ismPoints.size() * sizeof(glm::vec4), ismPoints.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+//Waits for the frame that last used this slot, so the CPU runs at most framesInFlight frames ahead of the GPU
+void beginFrameSlot() {
+	GLsync& fence = frameFences[frameSlot];
+	if (fence) {
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(fence);
+		fence = 0;
+	}
+	if (gBufferFences[frameSlot]) {
+		glDeleteSync(gBufferFences[frameSlot]);
+		gBufferFences[frameSlot] = 0;
+	}
+	//Ray counters are read back without blocking and reported once their frame has retired
+	cl_event& counters = rayCounterEvents[frameSlot];
+	if (counters) {
+		clWaitForEvents(1, &counters);
+		clReleaseEvent(counters);
+		counters = NULL;
+		int* readback = rayCounterReadbacks[frameSlot];
+		indirectRayCandidatesIA = ((indirectRayCandidatesIA * noOfFrames) + rayCandidates[frameSlot]) / (noOfFrames + 1);
+		indirectRaysTracedIA = ((indirectRaysTracedIA * noOfFrames) + readback[0]) / (noOfFrames + 1);
+		indirectRaysOccludedIA = ((indirectRaysOccludedIA * noOfFrames) + readback[1]) / (noOfFrames + 1);
+		Profiler::count(indirectRaysCounter, readback[0]);
+		Profiler::count(indirectOccludedCounter, readback[1]);
+	}
+}
+
+void endFrameSlot() {
+	frameFences[frameSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frameSlot = (frameSlot + 1) % framesInFlight;
 }
 
 void renderer::update(float deltaTime) {
+	beginFrameSlot();
+
+	if (Budget::isEnabled()) {
+		float vplTime = glm::max(Profiler::getLatest(vplIntersectionStage), 0.f) + glm::max(Profiler::getLatest(vplShootingStage), 0.f);
+		float indirectTime = glm::max(Profiler::getLatest(indirectIntersectionStage), 0.f) + glm::max(Profiler::getLatest(indirectColorStage), 0.f) + glm::max(Profiler::getLatest(indirectDiscontinuityStage), 0.f);
+		Budget::update(deltaTime * 1000, vplTime, indirectTime);
+		VPLWorker::setMaxGenPerFrame(Budget::getVPLGenPerFrame());
+	}
+	//Frames between indirect updates only reproject the history
+	bool indirectUpdate = ++framesSinceIndirect >= Budget::getIndirectInterval();
+	if (indirectUpdate)
+		framesSinceIndirect = 0;
+
 	float step = lightSpeed * deltaTime;
 	if (i) pls[0].position += step * glm::vec4(0, 1, 0, 0);
 	if (k) pls[0].position -= step * glm::vec4(0, 1, 0, 0);
@@ -728,219 +1282,56 @@ void renderer::update(float deltaTime) {
 	if (u) pls[0].position += step * glm::vec4(0, 0, 1, 0);
 	if (i || k || j || l || o || u) vplUpdated = true;
 
-	if (indirectEnabled) {
-		int lihi = iHistoryIndex - 1;
-		if (lihi < 0) lihi = iHistorySize;
-		lihi = iHistoryIndex % iHistorySize;
-		if (noOfInvalidVPLs < maxVPLGenPerFrame) {
-			for (int i = 0; i < noOfVPLS / iHistorySize; ++i) {
-				if (validVPLs[(lihi * noOfVPLS / iHistorySize) + i]) {
-					validVPLs[(lihi * noOfVPLS / iHistorySize) + i] = false;
-					noOfInvalidVPLs++;
-				}
-			}
-		}
-
-		intervalStart = SDL_GetTicks();
-
-		for (int i = 0; i < vpls.size(); ++i) {
-			Light pvpl;
-			LightExtra plex;
-			plex.type = 0;
-			if (i > noOfVPLS / noOfVPLBounces)
-				pvpl = vpls[i - (noOfVPLS / noOfVPLBounces)];
-			else {
-				pvpl = pls[i % noOfLights];
-				plex = plexs[i % noOfLights];
-			}
-			Light vpl = vpls[i];
-			RR::ray r;
-			glm::vec4 diff = vpl.position - pvpl.position;
-			if (plex.type == 2) {
-				float distance = getQuadLightDistance(pvpl, vpl);
-				r.o = RR::float4(vpl.position.x, vpl.position.y, vpl.position.z, distance);
-				r.d = RR::float3(-pvpl.normal.x, -pvpl.normal.y, -pvpl.normal.z);
-			}
-			else {
-				r.o = RR::float4(pvpl.position.x, pvpl.position.y, pvpl.position.z, glm::length(diff) - rDelta);
-				diff = glm::normalize(diff);
-				r.d = RR::float4(diff.x, diff.y, diff.z, 0.f);
-			}
-			vplRays[i] = r;
-		}
-
-		RR::Buffer* ray_buffer = intersectionApi->CreateBuffer(vpls.size() * sizeof(RR::ray), &vplRays);
-		RR::Buffer* occlu_buffer = intersectionApi->CreateBuffer(vpls.size() * sizeof(int), nullptr);
-
-		intersectionApi->QueryOcclusion(ray_buffer, vpls.size(), occlu_buffer, nullptr, nullptr);
-
-		int* occlus = nullptr;
-		RR::Event* e = nullptr;
-		intersectionApi->MapBuffer(occlu_buffer, RR::kMapRead, 0, vpls.size() * sizeof(int), (void**)& occlus, &e);
-
-		e->Wait();
-		intersectionApi->DeleteEvent(e);
-		e = nullptr;
-
-		for (int i = vpls.size() - 1; i >= 0; --i) {
-			bool outOfCone = false;
-			if (i < noOfVPLS / noOfVPLBounces) {
-				LightExtra plex = plexs[i % noOfLights];
-				Light pl = pls[i % noOfLights];
-				Light vpl = vpls[i];
-				if (plex.type == 1) {
-					glm::vec4 dir = glm::normalize(vpl.position - pl.position);
-					float angle = glm::dot(pl.normal, dir);
-					outOfCone = angle < plex.angle;
-				}
-				else if (plex.type == 2) {
-					float distance = getQuadLightDistance(pl, vpl);
-					glm::vec4 samplePos = vpl.position - (pl.normal * distance);
-					float driftX = glm::abs(samplePos.x - pl.position.x);
-					float driftY = glm::abs(samplePos.z - pl.position.z);
-					outOfCone = driftX > plex.quad.x || driftY > plex.quad.y;
-				}
-			}
-			if (occlus[i] != -1 || outOfCone) {
-				int j = i;
-				if (j < noOfVPLS && validVPLs[j]) {
-					validVPLs[j] = false;
-					noOfInvalidVPLs++;
-					j += (noOfVPLS / noOfVPLBounces);
-				}
-			}
-		}
+	//Any camera, light or mesh motion starts the average over, a still view regenerates a whole slice of VPLs per frame
+	bool still = progressiveEnabled && indirectEnabled && !Camera::isMoving() && !(i || k || j || l || o || u) && !Model::hasDynamicMeshes();
+	stillFrames = still ? stillFrames + 1 : 0;
+	if (progressiveEnabled && !Budget::isEnabled())
+		VPLWorker::setMaxGenPerFrame(still ? glm::max(baseVPLGenPerFrame, progressiveVPLGenPerFrame) : baseVPLGenPerFrame);
+	if (!still && accumulatedFrames > 0) {
+		static const float zero[4] = { 0, 0, 0, 0 };
+		glBindFramebuffer(GL_FRAMEBUFFER, accumBuffer);
+		glClearBufferfv(GL_COLOR, 0, zero);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		accumulatedFrames = 0;
+	}
 
-		intersectionApi->DeleteBuffer(occlu_buffer);
-		intersectionApi->DeleteBuffer(ray_buffer);
-
-		intervalEnd = SDL_GetTicks();
-		vplIntersectionIA = ((vplIntersectionIA * noOfFrames) + intervalEnd - intervalStart) / (noOfFrames + 1);
-		intervalStart = intervalEnd;
-
-		unsigned int noOfVPLSShot = 0;
-		unsigned int noOfVPLSTried = 0;
-		while (noOfVPLSShot < maxVPLGenPerFrame && noOfVPLSTried < noOfVPLS) {
-			noOfVPLSTried++;
-			currVPL = (currVPL + 1) % noOfVPLS;
-			if (!validVPLs[currVPL]) {
-				Light pvpl = pls[currVPL % noOfLights];
-				double* hltn = halton(1000 + vplNo++, 3);
-				double* chance = halton(1000 + vplNo, 1);
-				RR::ray r;
-				r.extra.x = currVPL;
-				r.extra.y = -(1 + (currVPL % noOfLights));
-				if (currVPL >= noOfVPLS / noOfVPLBounces) {
-					r.extra.y = currVPL - (noOfVPLS / noOfVPLBounces);
-					if (!validVPLs[r.extra.y]) {
-						continue;
-					}
-					pvpl = vpls[r.extra.y];
-					glm::vec3 dir = glm::vec3(2 * hltn[0] - 1, 2 * hltn[1] - 1, 2 * hltn[2] - 1);
-					glm::vec3 normal = glm::vec3(pvpl.normal.x, pvpl.normal.y, pvpl.normal.z);
-					dir = glm::faceforward(-dir, dir, normal);
-					r.o = RR::float4(pvpl.position.x, pvpl.position.y, pvpl.position.z, 1000.f);
-					r.d = RR::float3(dir.x, dir.y, dir.z);
+	if (indirectEnabled) {
+		VPLWorker::Job& job = VPLWorker::getJob();
+		job.pls = pls;
+		job.plexs = plexs;
+		job.historyIndex = iHistoryIndex;
+		job.modelTime = Model::getTime();
+		VPLWorker::submit();
+
+		//Threaded results trail the job by at least a frame, the newest finished set is picked up here
+		const VPLWorker::Result* result = VPLWorker::acquire();
+		if (result) {
+			noOfInvalidVPLs = result->noOfInvalid;
+			Profiler::recordCPU(vplIntersectionStage, result->validationTime);
+			Profiler::recordCPU(vplShootingStage, result->shootingTime);
+			Profiler::count(vplValidationRaysCounter, result->noOfValidationRays);
+			Profiler::count(vplValidationOccludedCounter, result->noOfValidationOccluded);
+			Profiler::count(vplShootingRaysCounter, result->noOfShootingRays);
+			Profiler::count(vplShootingHitsCounter, result->noOfShootingHits);
+			if (result->generation != vplGeneration) {
+				vplGeneration = result->generation;
+				//The previous upload reads straight out of vpls, it is long done by now but must not be overwritten early
+				if (vplWriteEvent) {
+					clWaitForEvents(1, &vplWriteEvent);
+					clReleaseEvent(vplWriteEvent);
 				}
-				else {
-					LightExtra plex = plexs[currVPL % noOfLights];
-					if (plex.type == 1) {//slightly out of bounds
-						hltn = halton(1000 + vplNo, 2);
-						hltn[0] = (plex.angle * (2 * hltn[0] - 1)) + acos(pvpl.normal.z);
-						hltn[1] = (plex.angle * (2 * hltn[1] - 1)) + atan(pvpl.normal.y / pvpl.normal.x);
-						r.o = RR::float4(pvpl.position.x, pvpl.position.y, pvpl.position.z, 1000.f);
-						r.d.x = sin(hltn[0]) * cos(hltn[1]);
-						r.d.y = sin(hltn[0]) * sin(hltn[1]);
-						r.d.z = cos(hltn[0]);
-					}
-					else if (plex.type == 2) {
-						hltn = halton(1000 + vplNo, 2);
-						r.o = RR::float4(pvpl.position.x, pvpl.position.y, pvpl.position.z, 1000.f);
-						r.o.x += (2 * hltn[0] - 1) * plex.quad.x;
-						r.o.z += (2 * hltn[1] - 1) * plex.quad.y;
-						r.d = RR::float3(pvpl.normal.x, pvpl.normal.y, pvpl.normal.z);
-					}
-					else {
-						r.o = RR::float4(pvpl.position.x, pvpl.position.y, pvpl.position.z, 1000.f);
-						r.d = RR::float3(2 * hltn[0] - 1, 2 * hltn[1] - 1, 2 * hltn[2] - 1);
-					}
+				if (incrementalMasks) {
+					//Masks traced before a VPL's stamp are stale for it, the in-order queue finishes this write before the VPL write's event
+					for (unsigned int v = 0; v < vpls.size(); ++v)
+						if (std::memcmp(&vpls[v], &result->vpls[v], sizeof(Light)) != 0)
+							vplStamps[v] = noOfFrames;
+					clEnqueueWriteBuffer(clQueue, clVPLStamps, CL_FALSE, 0, vplStamps.size() * sizeof(unsigned int), vplStamps.data(), 0, NULL, NULL);
 				}
-				vplRays[noOfVPLSShot] = r;
-				noOfVPLSShot++;
+				vpls = result->vpls;
+				clEnqueueWriteBuffer(clQueue, clVPLs, CL_FALSE, 0, vpls.size() * sizeof(Light), vpls.data(), 0, NULL, &vplWriteEvent);
+				vplUpdated = true;
 			}
 		}
-
-		if (noOfVPLSShot > 0) {
-			RR::Buffer* ray_buffer = intersectionApi->CreateBuffer(noOfVPLSShot * sizeof(RR::ray), &vplRays);
-			RR::Buffer* isect_buffer = intersectionApi->CreateBuffer(noOfVPLSShot * sizeof(RR::Intersection), nullptr);
-			intersectionApi->QueryIntersection(ray_buffer, noOfVPLSShot, isect_buffer, nullptr, nullptr);
-
-			RR::Event* e = nullptr;
-			RR::Intersection* isects = nullptr;
-			intersectionApi->MapBuffer(isect_buffer, RR::kMapRead, 0, noOfVPLSShot * sizeof(RR::Intersection), (void**)& isects, &e);
-
-			e->Wait();
-			intersectionApi->DeleteEvent(e);
-			e = nullptr;
-
-
-			for (int i = 0; i < noOfVPLSShot; ++i) {
-				RR::ray ray = vplRays[i];
-				RR::Intersection isect = isects[i];
-				if (isect.shapeid != -1) {
-					Light pvpl;
-					int vplIndex = ray.extra.x;
-					if (ray.extra.y >= 0) {
-						pvpl = vpls[ray.extra.y];
-					}
-					else {
-						pvpl = pls[-(1 + ray.extra.y)];
-					}
-					Light vpl;
-					float distance = isect.uvwt.w;
-					glm::vec4 normal = Model::getNormal(isect.shapeid, isect.primid, isect.uvwt.x, isect.uvwt.y);
-					vpl.normal = normal;
-					vpl.position = glm::vec4(
-						ray.o.x + (distance * ray.d.x) + (normal.x * rDelta),
-						ray.o.y + (distance * ray.d.y) + (normal.y * rDelta),
-						ray.o.z + (distance * ray.d.z) + (normal.z * rDelta),
-						1
-					);
-					glm::vec4 incident = glm::normalize(pvpl.position - vpl.position);
-					vpl.diffuse = Model::getDiffuse(isect.shapeid, isect.primid, isect.uvwt.x, isect.uvwt.y);
-					vpl.diffuse *= pvpl.diffuse * glm::max(glm::dot(normal, incident), 0.f) / (PI);
-					vpl.specular = glm::vec4(0, 0, 0, 1);
-					if (ray.extra.y >= 0) {
-						float dist = distance;
-						for (int j = ray.extra.y; j >= noOfVPLS / noOfVPLBounces; j -= noOfVPLS / noOfVPLBounces) {
-							int k = j - (noOfVPLS / noOfVPLBounces);
-							dist += glm::distance(vpls[j].position, vpls[k].position);
-						}
-						float attenuation = 1 / (1 + dist * dist);
-						vpl.diffuse *= attenuation;
-						vpl.specular *= attenuation;
-					}
-					else {
-						vpl.diffuse *= 10 * noOfVPLBounces / (float)noOfVPLS;
-						vpl.specular *= 10 * noOfVPLBounces / (float)noOfVPLS;
-					}
-					vpls[vplIndex] = vpl;
-					validVPLs[vplIndex] = true;
-					noOfInvalidVPLs--;
-				}
-			}
-
-			intersectionApi->DeleteBuffer(isect_buffer);
-			intersectionApi->DeleteBuffer(ray_buffer);
-
-			clEnqueueWriteBuffer(clQueue, clVPLs, CL_TRUE, 0, vpls.size() * sizeof(Light), vpls.data(), 0, NULL, NULL);
-
-			vplUpdated = true;
-		}
-
-		intervalEnd = SDL_GetTicks();
-		vplShootingIA = ((vplShootingIA * noOfFrames) + intervalEnd - intervalStart) / (noOfFrames + 1);
-		intervalStart = intervalEnd;
 	}
 
 	if (vplDebugEnabled && vplUpdated) {
@@ -954,7 +1345,7 @@ void renderer::update(float deltaTime) {
 				pvpl = pls[i % noOfLights];
 				LightExtra plex = plexs[i % noOfLights];
 				if (plex.type == 2) {
-					float distance = getQuadLightDistance(pvpl, vpls[i]);
+					float distance = VPL::getQuadLightDistance(pvpl, vpls[i]);
 					pvpl.position = vpls[i].position - (pvpl.normal * distance);
 				}
 			}
@@ -966,6 +1357,7 @@ void renderer::update(float deltaTime) {
 		glGenVertexArrays(1, &vpl_vao);
 		glBindVertexArray(vpl_vao);
 		glBindBuffer(GL_ARRAY_BUFFER, vpl_vbo);
+		Resources::addBuffer("Debug", "vpl_vbo", "GL buffer", vpls2.size() * sizeof(Light));
 		glBufferData(GL_ARRAY_BUFFER, vpls2.size() * sizeof(Light), vpls2.data(), GL_DYNAMIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Light), (void*)offsetof(Light, position));
@@ -974,6 +1366,7 @@ void renderer::update(float deltaTime) {
 	}
 
 	if (directEnabled) {
+		Profiler::beginGL(directShadowStage);
 		glViewport(0, 0, dpth_width, dpth_height);
 
 		for (int i = 0; i < noOfLights; ++i) {
@@ -1005,12 +1398,10 @@ void renderer::update(float deltaTime) {
 
 		}
 
-		glFinish();
-		intervalEnd = SDL_GetTicks();
-		directShadowIA = ((directShadowIA * noOfFrames) + intervalEnd - intervalStart) / (noOfFrames + 1);
-		intervalStart = intervalEnd;
+		Profiler::endGL(directShadowStage);
 	}
 
+	Profiler::beginGL(gBufferStage);
 	glViewport(0, 0, p_width, p_height);
 	glm::mat4 view = Camera::getViewMatrix();
 	glm::vec3 position = Camera::getPosition();
@@ -1022,12 +1413,10 @@ void renderer::update(float deltaTime) {
 	glUniformMatrix4fv(glGetUniformLocation(gBufferShader, "projection"), 1, GL_FALSE, &projection[0][0]);
 	Model::draw(gBufferShader);
 
-	glFinish();
-	intervalEnd = SDL_GetTicks();
-	gBufferIA = ((gBufferIA * noOfFrames) + intervalEnd - intervalStart) / (noOfFrames + 1);
-	intervalStart = intervalEnd;
+	Profiler::endGL(gBufferStage);
 
 	if (directEnabled) {
+		Profiler::beginGL(directColorStage);
 		unsigned int cdBuffer;
 		unsigned int cdColor;
 		for (int i = 0; i < noOfLights; ++i) {
@@ -1082,70 +1471,342 @@ void renderer::update(float deltaTime) {
 			glDrawArrays(GL_TRIANGLES, 0, 6);
 		}
 
-		glFinish();
-		intervalEnd = SDL_GetTicks();
-		directColorIA = ((directColorIA * noOfFrames) + intervalEnd - intervalStart) / (noOfFrames + 1);
-		intervalStart = intervalEnd;
+		Profiler::endGL(directColorStage);
 	}
 
-	if (indirectEnabled && vpls.size() > 0) {
-		clEnqueueAcquireGLObjects(clQueue, 1, &clPositions, 0, 0, NULL);
-		clEnqueueAcquireGLObjects(clQueue, 1, &clMasks, 0, 0, NULL);
+	if (indirectEnabled && indirectUpdate && vpls.size() > 0 && lightcutEnabled) {
+		Profiler::beginCPU(lightTreeStage);
+		unsigned int cells = interleavedSamplingSize * interleavedSamplingSize;
+		lightTreeNodes.clear();
+		for (unsigned int c = 0; c < cells; ++c) {
+			for (unsigned int v = 0; v < lightTreeLeaves; ++v) {
+				unsigned int pv = iHistorySize * (lightTreeLeaves * c + v) + iHistoryIndex;
+				unsigned int firstBounceVPLI = pv % (noOfVPLS / noOfVPLBounces);
+				lightTreeIndices[v] = pv;
+				lightTreePathDists[v] = glm::distance(pls[firstBounceVPLI % noOfLights].position, vpls[firstBounceVPLI].position);
+			}
+			LightTree::build(vpls, lightTreeIndices, lightTreePathDists, lightcutNormalWeight, lightTreeNodes);
+		}
 
-		float realVPP = vpls.size() / (float)(interleavedSamplingSize * interleavedSamplingSize * iHistorySize);
-		unsigned int vplsPerPixel = realVPP;
-		size_t global_item_size[3] = { iWidth, iHeight, vplsPerPixel };
+		glBindBuffer(GL_TEXTURE_BUFFER, lightTreeBuffer);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, lightTreeNodes.size() * sizeof(LightTree::Node), lightTreeNodes.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		clEnqueueWriteBuffer(clQueue, clLightTree, CL_FALSE, 0, lightTreeNodes.size() * sizeof(LightTree::Node), lightTreeNodes.data(), 0, NULL, NULL);
 
-		if (realVPP < 1) {
-			global_item_size[0] = iWidth * realVPP;
-			global_item_size[1] = iHeight * realVPP;
-			global_item_size[2] = 1;
-			vplsPerPixel = 1;
+		Profiler::endCPU(lightTreeStage);
+	}
+
+	if (indirectEnabled && indirectUpdate && vpls.size() > 0) {
+		if (visibilityBackend == VISIBILITY_ISM) {
+			Profiler::beginGL(indirectIntersectionStage);
+			updateISMPoints();
+			glBindBuffer(GL_TEXTURE_BUFFER, ismVPLBuffer);
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, vpls.size() * sizeof(Light), vpls.data());
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+			glViewport(0, 0, ismSize * ismTilesPerRow, ismSize * ismTilesPerRow);
+			glBindFramebuffer(GL_FRAMEBUFFER, ismFBO);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glEnable(GL_DEPTH_TEST);
+			glEnable(GL_PROGRAM_POINT_SIZE);
+			glUseProgram(ismShader);
+			glUniform1i(glGetUniformLocation(ismShader, "points"), 0);
+			glUniform1i(glGetUniformLocation(ismShader, "vpls"), 1);
+			glUniform1i(glGetUniformLocation(ismShader, "pointsPerMap"), ismPointsPerMap);
+			glUniform1i(glGetUniformLocation(ismShader, "noOfPointSets"), ismPointSets);
+			glUniform1i(glGetUniformLocation(ismShader, "iHistoryIndex"), iHistoryIndex);
+			glUniform1i(glGetUniformLocation(ismShader, "iHistorySize"), iHistorySize);
+			glUniform1i(glGetUniformLocation(ismShader, "tilesPerRow"), ismTilesPerRow);
+			glUniform1f(glGetUniformLocation(ismShader, "far_plane"), ismFarPlane);
+			glUniform1f(glGetUniformLocation(ismShader, "pointSize"), ismPointSize);
+			glUniform1i(glGetUniformLocation(ismShader, "tileSize"), ismSize);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_BUFFER, ismPointTexture);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_BUFFER, ismVPLTexture);
+			glBindVertexArray(ismVAO);
+			if (!ismPoints.empty())
+				glDrawArraysInstanced(GL_POINTS, 0, ismPointsPerMap, vpls.size() / iHistorySize);
+			glDisable(GL_PROGRAM_POINT_SIZE);
+			glViewport(0, 0, p_width, p_height);
+			Profiler::endGL(indirectIntersectionStage);
 		}
 		else {
-			realVPP = 1;
+			if (pipelinedIndirect) {
+				//Last frame's trace is shaded below while this frame traces into the other set
+				std::swap(vMasks, vMasksBack);
+				std::swap(clMasks, clMasksBack);
+				std::swap(snapPosition, snapPositionBack);
+				std::swap(snapNormal, snapNormalBack);
+				std::swap(clPositions, clPositionsBack);
+				std::swap(clNormals, clNormalsBack);
+				glCopyImageSubData(gPosition, GL_TEXTURE_2D, 0, 0, 0, 0, snapPosition, GL_TEXTURE_2D, 0, 0, 0, 0, p_width, p_height, 1);
+				glCopyImageSubData(gNormal, GL_TEXTURE_2D, 0, 0, 0, 0, snapNormal, GL_TEXTURE_2D, 0, 0, 0, 0, p_width, p_height, 1);
+				if (!pipelinePrimed) {
+					glCopyImageSubData(gPosition, GL_TEXTURE_2D, 0, 0, 0, 0, snapPositionBack, GL_TEXTURE_2D, 0, 0, 0, 0, p_width, p_height, 1);
+					glCopyImageSubData(gNormal, GL_TEXTURE_2D, 0, 0, 0, 0, snapNormalBack, GL_TEXTURE_2D, 0, 0, 0, 0, p_width, p_height, 1);
+					traceVPLs = vpls;
+					traceView = view;
+					pipelinePrimed = true;
+				}
+				shadeVPLs.swap(traceVPLs);
+				traceVPLs = vpls;
+				shadeView = traceView;
+				traceView = view;
+				shadeEvent = traceEvent;
+				traceEvent = NULL;
+			}
+			//The slice traced here is the one shaded, a frame later when pipelined
+			unsigned int traceIndex = pipelinedIndirect ? (iHistoryIndex + 1) % iHistorySize : iHistoryIndex;
+
+			//OpenCL may only acquire the G-buffer once GL has finished writing it, with sync interop the queue waits on a fence instead of the CPU
+			cl_mem shared[3] = { clPositions, clNormals, clMasks };
+			cl_event gBufferEvent = NULL;
+			if (syncInterop) {
+				gBufferFences[frameSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				glFlush();
+				gBufferEvent = clCreateEventFromGLsync(clContext, (cl_GLsync)gBufferFences[frameSlot], NULL);
+			}
+			else {
+				glFinish();
+			}
+			Profiler::beginCL(indirectIntersectionStage);
+			clEnqueueAcquireGLObjects(clQueue, 3, shared, gBufferEvent ? 1 : 0, gBufferEvent ? &gBufferEvent : NULL, NULL);
+			if (gBufferEvent)
+				clReleaseEvent(gBufferEvent);
+
+			float realVPP = vpls.size() / (float)(interleavedSamplingSize * interleavedSamplingSize * iHistorySize);
+			unsigned int vplsPerPixel = realVPP;
+			size_t global_item_size[3] = { iWidth, iHeight, vplsPerPixel };
+
+			if (realVPP < 1) {
+				global_item_size[0] = iWidth * realVPP;
+				global_item_size[1] = iHeight * realVPP;
+				global_item_size[2] = 1;
+				vplsPerPixel = 1;
+			}
+			else {
+				realVPP = 1;
+			}
+			size_t local_item_size[3] = { 1, 1, 1 };
+
+			//std::cout << global_item_size[0] << ", " << global_item_size[1] << ", " << global_item_size[2] << ", " << realVPP << std::endl;
+
+			unsigned int lightTreeSize = LightTree::getTreeSize(lightTreeLeaves);
+			unsigned int lightTreeRoot = LightTree::getRoot(lightTreeLeaves);
+			unsigned int lightcut = lightcutEnabled;
+			unsigned int culling = cullingEnabled;
+			unsigned int rayStats = rayStatsEnabled;
+			if (rayStatsEnabled) {
+				static const int zero[2] = { 0, 0 };
+				clEnqueueWriteBuffer(clQueue, clRayCounters, CL_FALSE, 0, 2 * sizeof(int), zero, 0, NULL, NULL);
+			}
+
+			if (visibilityBackend == VISIBILITY_SHARED_ORIGIN && realVPP == 1) {
+				Profiler::beginCPU(bvhRefitStage);
+				updateSceneBVH();
+				Profiler::endCPU(bvhRefitStage);
+
+				unsigned int packet = SHARED_ORIGIN_PACKET_WIDTH;
+				unsigned int cellsX = (iWidth + interleavedSamplingSize - 1) / interleavedSamplingSize;
+				unsigned int cellsY = (iHeight + interleavedSamplingSize - 1) / interleavedSamplingSize;
+				size_t packet_global_size[3] = { ((cellsX + packet - 1) / packet) * packet, ((cellsY + packet - 1) / packet) * packet, interleavedSamplingSize * interleavedSamplingSize * vplsPerPixel };
+				size_t packet_local_size[3] = { packet, packet, 1 };
+
+				clSetKernelArg(clSharedOriginKernel, 0, sizeof(cl_mem), (void*)& clPositions);
+				clSetKernelArg(clSharedOriginKernel, 1, sizeof(cl_mem), (void*)& clNormals);
+				clSetKernelArg(clSharedOriginKernel, 2, sizeof(cl_mem), (void*)& clVPLs);
+				clSetKernelArg(clSharedOriginKernel, 3, sizeof(unsigned int), &vplsPerPixel);
+				clSetKernelArg(clSharedOriginKernel, 4, sizeof(unsigned int), &p_width);
+				clSetKernelArg(clSharedOriginKernel, 5, sizeof(unsigned int), &iWidth);
+				clSetKernelArg(clSharedOriginKernel, 6, sizeof(unsigned int), &iHeight);
+				clSetKernelArg(clSharedOriginKernel, 7, sizeof(unsigned int), &interleavedSamplingSize);
+				clSetKernelArg(clSharedOriginKernel, 8, sizeof(unsigned int), &traceIndex);
+				clSetKernelArg(clSharedOriginKernel, 9, sizeof(unsigned int), &iHistorySize);
+				clSetKernelArg(clSharedOriginKernel, 10, sizeof(cl_mem), (void*)& clBVHNodes);
+				clSetKernelArg(clSharedOriginKernel, 11, sizeof(cl_mem), (void*)& clBVHTriangles);
+				clSetKernelArg(clSharedOriginKernel, 12, sizeof(cl_mem), (void*)& clLightTree);
+				clSetKernelArg(clSharedOriginKernel, 13, sizeof(unsigned int), &lightTreeSize);
+				clSetKernelArg(clSharedOriginKernel, 14, sizeof(unsigned int), &lightTreeRoot);
+				clSetKernelArg(clSharedOriginKernel, 15, sizeof(float), &lightcutError);
+				clSetKernelArg(clSharedOriginKernel, 16, sizeof(unsigned int), &lightcutMaxCut);
+				clSetKernelArg(clSharedOriginKernel, 17, sizeof(unsigned int), &lightcut);
+				clSetKernelArg(clSharedOriginKernel, 18, sizeof(float), &cullThreshold);
+				clSetKernelArg(clSharedOriginKernel, 19, sizeof(unsigned int), &culling);
+				clSetKernelArg(clSharedOriginKernel, 20, sizeof(unsigned int), &rayStats);
+				clSetKernelArg(clSharedOriginKernel, 21, sizeof(cl_mem), (void*)& clRayCounters);
+				clSetKernelArg(clSharedOriginKernel, 22, sizeof(cl_mem), (void*)& clMasks);
+
+				clEnqueueNDRangeKernel(clQueue, clSharedOriginKernel, 3, NULL, packet_global_size, packet_local_size, 0, NULL, NULL);
+			}
+			else {
+				//Tiles are only coarse-tested when every pixel of a cell uses whole VPLs
+				unsigned int adaptive = adaptiveEnabled && realVPP == 1;
+				if (adaptive) {
+					size_t tile_global_size[3] = { tilesX, tilesY, interleavedSamplingSize * interleavedSamplingSize * vplsPerPixel };
+					cl_float4 viewPos = { position.x, position.y, position.z, 1 };
+
+					clSetKernelArg(clTileDiscontinuityKernel, 0, sizeof(cl_mem), (void*)& clPositions);
+					clSetKernelArg(clTileDiscontinuityKernel, 1, sizeof(cl_mem), (void*)& clNormals);
+					clSetKernelArg(clTileDiscontinuityKernel, 2, sizeof(unsigned int), &p_width);
+					clSetKernelArg(clTileDiscontinuityKernel, 3, sizeof(unsigned int), &iWidth);
+					clSetKernelArg(clTileDiscontinuityKernel, 4, sizeof(unsigned int), &iHeight);
+					clSetKernelArg(clTileDiscontinuityKernel, 5, sizeof(unsigned int), &adaptiveTileSize);
+					clSetKernelArg(clTileDiscontinuityKernel, 6, sizeof(cl_float4), &viewPos);
+					clSetKernelArg(clTileDiscontinuityKernel, 7, sizeof(float), &adaptiveDepthThreshold);
+					clSetKernelArg(clTileDiscontinuityKernel, 8, sizeof(float), &adaptiveNormalThreshold);
+					clSetKernelArg(clTileDiscontinuityKernel, 9, sizeof(cl_mem), (void*)& clTileDisc);
+
+					clEnqueueNDRangeKernel(clQueue, clTileDiscontinuityKernel, 2, NULL, tile_global_size, local_item_size, 0, NULL, NULL);
+
+					clSetKernelArg(clTileRaysKernel, 0, sizeof(cl_mem), (void*)& clPositions);
+					clSetKernelArg(clTileRaysKernel, 1, sizeof(cl_mem), (void*)& clVPLs);
+					clSetKernelArg(clTileRaysKernel, 2, sizeof(unsigned int), &vplsPerPixel);
+					clSetKernelArg(clTileRaysKernel, 3, sizeof(unsigned int), &p_width);
+					clSetKernelArg(clTileRaysKernel, 4, sizeof(unsigned int), &iWidth);
+					clSetKernelArg(clTileRaysKernel, 5, sizeof(unsigned int), &iHeight);
+					clSetKernelArg(clTileRaysKernel, 6, sizeof(unsigned int), &interleavedSamplingSize);
+					clSetKernelArg(clTileRaysKernel, 7, sizeof(unsigned int), &traceIndex);
+					clSetKernelArg(clTileRaysKernel, 8, sizeof(unsigned int), &iHistorySize);
+					clSetKernelArg(clTileRaysKernel, 9, sizeof(unsigned int), &adaptiveTileSize);
+					clSetKernelArg(clTileRaysKernel, 10, sizeof(cl_mem), (void*)& clTileRays);
+
+					clEnqueueNDRangeKernel(clQueue, clTileRaysKernel, 3, NULL, tile_global_size, local_item_size, 0, NULL, NULL);
+
+					unsigned int noOfTileRays = tile_global_size[0] * tile_global_size[1] * tile_global_size[2] * TILE_SAMPLES;
+					intersectionApi->QueryOcclusion(rrTileRays, noOfTileRays, rrTileOcclus, nullptr, nullptr);
+					indirectTileRaysIA = ((indirectTileRaysIA * noOfFrames) + noOfTileRays) / (noOfFrames + 1);
+					Profiler::count(indirectTileRaysCounter, noOfTileRays);
+				}
+
+				clSetKernelArg(clPreRaysKernel, 0, sizeof(cl_mem), (void*)& clPositions);
+				clSetKernelArg(clPreRaysKernel, 1, sizeof(cl_mem), (void*)& clNormals);
+				clSetKernelArg(clPreRaysKernel, 2, sizeof(cl_mem), (void*)& clVPLs);
+				clSetKernelArg(clPreRaysKernel, 3, sizeof(unsigned int), &vplsPerPixel);
+				clSetKernelArg(clPreRaysKernel, 4, sizeof(float), &realVPP);
+				clSetKernelArg(clPreRaysKernel, 5, sizeof(unsigned int), &p_width);
+				clSetKernelArg(clPreRaysKernel, 6, sizeof(unsigned int), &iWidth);
+				clSetKernelArg(clPreRaysKernel, 7, sizeof(unsigned int), &interleavedSamplingSize);
+				clSetKernelArg(clPreRaysKernel, 8, sizeof(unsigned int), &traceIndex);
+				clSetKernelArg(clPreRaysKernel, 9, sizeof(unsigned int), &iHistorySize);
+				clSetKernelArg(clPreRaysKernel, 10, sizeof(cl_mem), (void*)& clRays);
+				clSetKernelArg(clPreRaysKernel, 11, sizeof(cl_mem), (void*)& clLightTree);
+				clSetKernelArg(clPreRaysKernel, 12, sizeof(unsigned int), &lightTreeSize);
+				clSetKernelArg(clPreRaysKernel, 13, sizeof(unsigned int), &lightTreeRoot);
+				clSetKernelArg(clPreRaysKernel, 14, sizeof(float), &lightcutError);
+				clSetKernelArg(clPreRaysKernel, 15, sizeof(unsigned int), &lightcutMaxCut);
+				clSetKernelArg(clPreRaysKernel, 16, sizeof(unsigned int), &lightcut);
+				clSetKernelArg(clPreRaysKernel, 17, sizeof(float), &cullThreshold);
+				clSetKernelArg(clPreRaysKernel, 18, sizeof(unsigned int), &culling);
+				clSetKernelArg(clPreRaysKernel, 19, sizeof(unsigned int), &rayStats);
+				clSetKernelArg(clPreRaysKernel, 20, sizeof(cl_mem), (void*)& clRayCounters);
+				clSetKernelArg(clPreRaysKernel, 21, sizeof(unsigned int), &adaptive);
+				clSetKernelArg(clPreRaysKernel, 22, sizeof(unsigned int), &adaptiveTileSize);
+				clSetKernelArg(clPreRaysKernel, 23, sizeof(unsigned int), &tilesX);
+				clSetKernelArg(clPreRaysKernel, 24, sizeof(cl_mem), (void*)& clTileOcclus);
+				clSetKernelArg(clPreRaysKernel, 25, sizeof(cl_mem), (void*)& clTileDisc);
+
+				//Pairs whose surface point, VPL and the dynamic geometry between them are unchanged since the slice was last traced keep their mask
+				unsigned int cache = incrementalMasks && realVPP == 1;
+				unsigned int parity = sliceParity[traceIndex];
+				cl_float16 prevViewProjection;
+				std::memcpy(&prevViewProjection, &sliceViewProjections[traceIndex], sizeof(cl_float16));
+				glm::vec3 movedMin(1), movedMax(0);
+				if (cache && sliceTimes[traceIndex] != Model::getTime())
+					Model::getDynamicBounds(sliceTimes[traceIndex], Model::getTime(), movedMin, movedMax);
+				cl_float4 boundsMin = { movedMin.x, movedMin.y, movedMin.z, 0 };
+				cl_float4 boundsMax = { movedMax.x, movedMax.y, movedMax.z, 0 };
+				clSetKernelArg(clPreRaysKernel, 26, sizeof(unsigned int), &cache);
+				clSetKernelArg(clPreRaysKernel, 27, sizeof(unsigned int), &iHeight);
+				clSetKernelArg(clPreRaysKernel, 28, sizeof(cl_mem), (void*)& clMaskCache[parity]);
+				clSetKernelArg(clPreRaysKernel, 29, sizeof(cl_mem), (void*)& clMaskCachePositions[parity]);
+				clSetKernelArg(clPreRaysKernel, 30, sizeof(cl_mem), (void*)& clMaskCachePositions[1 - parity]);
+				clSetKernelArg(clPreRaysKernel, 31, sizeof(cl_float16), &prevViewProjection);
+				clSetKernelArg(clPreRaysKernel, 32, sizeof(float), &maskCacheThreshold);
+				clSetKernelArg(clPreRaysKernel, 33, sizeof(cl_mem), (void*)& clVPLStamps);
+				clSetKernelArg(clPreRaysKernel, 34, sizeof(unsigned int), &sliceFrames[traceIndex]);
+				clSetKernelArg(clPreRaysKernel, 35, sizeof(cl_float4), &boundsMin);
+				clSetKernelArg(clPreRaysKernel, 36, sizeof(cl_float4), &boundsMax);
+
+				clEnqueueNDRangeKernel(clQueue, clPreRaysKernel, 3, NULL, global_item_size, local_item_size, 0, NULL, NULL);
+
+				intersectionApi->QueryOcclusion(rrRays, global_item_size[0] * global_item_size[1] * global_item_size[2], rrOcclus, nullptr, nullptr);
+
+				clSetKernelArg(clPostRaysKernel, 0, sizeof(cl_mem), (void*)& clRays);
+				clSetKernelArg(clPostRaysKernel, 1, sizeof(cl_mem), (void*)& clOcclus);
+				clSetKernelArg(clPostRaysKernel, 2, sizeof(unsigned int), &vplsPerPixel);
+				clSetKernelArg(clPostRaysKernel, 3, sizeof(float), &realVPP);
+				clSetKernelArg(clPostRaysKernel, 4, sizeof(unsigned int), &p_width);
+				clSetKernelArg(clPostRaysKernel, 5, sizeof(unsigned int), &iWidth);
+				clSetKernelArg(clPostRaysKernel, 6, sizeof(unsigned int), &interleavedSamplingSize);
+				clSetKernelArg(clPostRaysKernel, 7, sizeof(unsigned int), &traceIndex);
+				clSetKernelArg(clPostRaysKernel, 8, sizeof(unsigned int), &iHistorySize);
+				clSetKernelArg(clPostRaysKernel, 9, sizeof(cl_mem), (void*)& clVPLs);
+				clSetKernelArg(clPostRaysKernel, 10, sizeof(cl_mem), (void*)& clMasks);
+				clSetKernelArg(clPostRaysKernel, 11, sizeof(unsigned int), &rayStats);
+				clSetKernelArg(clPostRaysKernel, 12, sizeof(cl_mem), (void*)& clRayCounters);
+				clSetKernelArg(clPostRaysKernel, 13, sizeof(unsigned int), &cache);
+				clSetKernelArg(clPostRaysKernel, 14, sizeof(unsigned int), &iHeight);
+				clSetKernelArg(clPostRaysKernel, 15, sizeof(cl_mem), (void*)& clMaskCache[1 - parity]);
+
+				clEnqueueNDRangeKernel(clQueue, clPostRaysKernel, 3, NULL, global_item_size, local_item_size, 0, NULL, NULL);
+
+				if (cache) {
+					sliceFrames[traceIndex] = noOfFrames;
+					sliceTimes[traceIndex] = Model::getTime();
+					sliceViewProjections[traceIndex] = projection * view;
+					sliceParity[traceIndex] = 1 - parity;
+				}
+			}
+
+			if (rayStatsEnabled) {
+				clEnqueueReadBuffer(clQueue, clRayCounters, CL_FALSE, 0, 2 * sizeof(int), rayCounterReadbacks[frameSlot], 0, NULL, &rayCounterEvents[frameSlot]);
+				rayCandidates[frameSlot] = global_item_size[0] * global_item_size[1] * global_item_size[2];
+			}
+			else {
+				//Without the kernel counters every candidate counts as traced
+				Profiler::count(indirectRaysCounter, global_item_size[0] * global_item_size[1] * global_item_size[2]);
+			}
+
+			//GL waits for the masks on the GPU, the CPU carries on recording the rest of the frame
+			cl_event releaseEvent = NULL;
+			clEnqueueReleaseGLObjects(clQueue, 3, shared, 0, NULL, syncInterop || pipelinedIndirect ? &releaseEvent : NULL);
+			Profiler::endCL(indirectIntersectionStage);
+			if (pipelinedIndirect) {
+				//Nothing reads these masks until next frame's shading, which waits on the release
+				clFlush(clQueue);
+				traceEvent = releaseEvent;
+			}
+			else if (syncInterop) {
+				clFlush(clQueue);
+				GLsync masksFence = glCreateSyncFromCLeventARB(clContext, releaseEvent, 0);
+				glWaitSync(masksFence, 0, GL_TIMEOUT_IGNORED);
+				glDeleteSync(masksFence);
+				clReleaseEvent(releaseEvent);
+			}
+			else {
+				clFinish(clQueue);
+			}
 		}
-		size_t local_item_size[3] = { 1, 1, 1 };
-
-		//std::cout << global_item_size[0] << ", " << global_item_size[1] << ", " << global_item_size[2] << ", " << realVPP << std::endl;
-
-		clSetKernelArg(clPreRaysKernel, 0, sizeof(cl_mem), (void*)& clPositions);
-		clSetKernelArg(clPreRaysKernel, 1, sizeof(cl_mem), (void*)& clVPLs);
-		clSetKernelArg(clPreRaysKernel, 2, sizeof(unsigned int), &vplsPerPixel);
-		clSetKernelArg(clPreRaysKernel, 3, sizeof(float), &realVPP);
-		clSetKernelArg(clPreRaysKernel, 4, sizeof(unsigned int), &p_width);
-		clSetKernelArg(clPreRaysKernel, 5, sizeof(unsigned int), &iWidth);
-		clSetKernelArg(clPreRaysKernel, 6, sizeof(unsigned int), &interleavedSamplingSize);
-		clSetKernelArg(clPreRaysKernel, 7, sizeof(unsigned int), &iHistoryIndex);
-		clSetKernelArg(clPreRaysKernel, 8, sizeof(unsigned int), &iHistorySize);
-		clSetKernelArg(clPreRaysKernel, 9, sizeof(cl_mem), (void*)& clRays);
-
-		clEnqueueNDRangeKernel(clQueue, clPreRaysKernel, 3, NULL, global_item_size, local_item_size, 0, NULL, NULL);
-
-		intersectionApi->QueryOcclusion(rrRays, global_item_size[0] * global_item_size[1] * global_item_size[2], rrOcclus, nullptr, nullptr);
-
-		clSetKernelArg(clPostRaysKernel, 0, sizeof(cl_mem), (void*)& clRays);
-		clSetKernelArg(clPostRaysKernel, 1, sizeof(cl_mem), (void*)& clOcclus);
-		clSetKernelArg(clPostRaysKernel, 2, sizeof(unsigned int), &vplsPerPixel);
-		clSetKernelArg(clPostRaysKernel, 3, sizeof(float), &realVPP);
-		clSetKernelArg(clPostRaysKernel, 4, sizeof(unsigned int), &p_width);
-		clSetKernelArg(clPostRaysKernel, 5, sizeof(unsigned int), &iWidth);
-		clSetKernelArg(clPostRaysKernel, 6, sizeof(unsigned int), &interleavedSamplingSize);
-		clSetKernelArg(clPostRaysKernel, 7, sizeof(unsigned int), &iHistoryIndex);
-		clSetKernelArg(clPostRaysKernel, 8, sizeof(unsigned int), &iHistorySize);
-		clSetKernelArg(clPostRaysKernel, 9, sizeof(cl_mem), (void*)& clVPLs);
-		clSetKernelArg(clPostRaysKernel, 10, sizeof(cl_mem), (void*)& clMasks);
-
-		clEnqueueNDRangeKernel(clQueue, clPostRaysKernel, 3, NULL, global_item_size, local_item_size, 0, NULL, NULL);
-
-		clEnqueueReleaseGLObjects(clQueue, 1, &clMasks, 0, 0, NULL);
-		clEnqueueReleaseGLObjects(clQueue, 1, &clPositions, 0, 0, NULL);
-		clFinish(clQueue);
 
-		intervalEnd = SDL_GetTicks();
-		indirectIntersectionIA = ((indirectIntersectionIA * noOfFrames) + intervalEnd - intervalStart) / (noOfFrames + 1);
-		intervalStart = intervalEnd;
+		unsigned int shadePosition = pipelinedIndirect ? snapPositionBack : gPosition;
+		unsigned int shadeNormal = pipelinedIndirect ? snapNormalBack : gNormal;
+		unsigned int shadeMasks = pipelinedIndirect ? vMasksBack : vMasks;
+		const std::vector<Light>& shadeLights = pipelinedIndirect ? shadeVPLs : vpls;
+		if (shadeEvent) {
+			if (syncInterop) {
+				GLsync masksFence = glCreateSyncFromCLeventARB(clContext, shadeEvent, 0);
+				glWaitSync(masksFence, 0, GL_TIMEOUT_IGNORED);
+				glDeleteSync(masksFence);
+			}
+			else {
+				clWaitForEvents(1, &shadeEvent);
+			}
+			clReleaseEvent(shadeEvent);
+			shadeEvent = NULL;
+		}
 
+		Profiler::beginGL(indirectColorStage);
 		glBindFramebuffer(GL_FRAMEBUFFER, iBuffer);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glDisable(GL_DEPTH_TEST);
@@ -1158,34 +1819,50 @@ void renderer::update(float deltaTime) {
 			glUniform3fv(glGetUniformLocation(iPlaneShader, ("pls[" + std::to_string(i) + "].diffuse").c_str()), 1, &pls[i].diffuse[0]);
 			glUniform3fv(glGetUniformLocation(iPlaneShader, ("pls.[" + std::to_string(i) + "].specular").c_str()), 1, &pls[i].specular[0]);
 		}
-		for (int i = 0; i < noOfVPLS; ++i) {
-			glUniform3fv(glGetUniformLocation(iPlaneShader, ("vpls[" + std::to_string(i) + "].position").c_str()), 1, &vpls[i].position[0]);
-			glUniform3fv(glGetUniformLocation(iPlaneShader, ("vpls[" + std::to_string(i) + "].diffuse").c_str()), 1, &vpls[i].diffuse[0]);
-			glUniform3fv(glGetUniformLocation(iPlaneShader, ("vpls[" + std::to_string(i) + "].specular").c_str()), 1, &vpls[i].specular[0]);
+		for (int i = 0; i < noOfVPLS && !lightcutEnabled; ++i) {
+			glUniform3fv(glGetUniformLocation(iPlaneShader, ("vpls[" + std::to_string(i) + "].position").c_str()), 1, &shadeLights[i].position[0]);
+			glUniform3fv(glGetUniformLocation(iPlaneShader, ("vpls[" + std::to_string(i) + "].diffuse").c_str()), 1, &shadeLights[i].diffuse[0]);
+			glUniform3fv(glGetUniformLocation(iPlaneShader, ("vpls[" + std::to_string(i) + "].specular").c_str()), 1, &shadeLights[i].specular[0]);
+			glUniform3fv(glGetUniformLocation(iPlaneShader, ("vpls[" + std::to_string(i) + "].normal").c_str()), 1, &shadeLights[i].normal[0]);
 		}
+		glUniform1i(glGetUniformLocation(iPlaneShader, "lightcutEnabled"), lightcutEnabled);
+		glUniform1i(glGetUniformLocation(iPlaneShader, "lightTree"), 5);
+		glUniform1i(glGetUniformLocation(iPlaneShader, "lightTreeSize"), LightTree::getTreeSize(lightTreeLeaves));
+		glUniform1i(glGetUniformLocation(iPlaneShader, "lightTreeRoot"), LightTree::getRoot(lightTreeLeaves));
+		glUniform1f(glGetUniformLocation(iPlaneShader, "lightcutError"), lightcutError);
+		glUniform1i(glGetUniformLocation(iPlaneShader, "lightcutMaxCut"), lightcutMaxCut);
+		glUniform1i(glGetUniformLocation(iPlaneShader, "iss"), interleavedSamplingSize);
+		glUniform1i(glGetUniformLocation(iPlaneShader, "ismEnabled"), visibilityBackend == VISIBILITY_ISM);
+		glUniform1i(glGetUniformLocation(iPlaneShader, "ismAtlas"), 6);
+		glUniform1i(glGetUniformLocation(iPlaneShader, "ismTilesPerRow"), ismTilesPerRow);
+		glUniform1f(glGetUniformLocation(iPlaneShader, "ismFarPlane"), ismFarPlane);
+		glUniform1f(glGetUniformLocation(iPlaneShader, "ismBias"), ismBias);
 		glUniform1f(glGetUniformLocation(iPlaneShader, "idScale"), p_width / (float)iWidth);
 		glUniform1i(glGetUniformLocation(iPlaneShader, "vplMasks"), 4);
 		glUniform1i(glGetUniformLocation(iPlaneShader, "debugVPLI"), debugVPL);
+		glUniform1i(glGetUniformLocation(iPlaneShader, "adaptiveDebug"), adaptiveEnabled && adaptiveDebugEnabled && visibilityBackend == VISIBILITY_RADEONRAYS);
 		glUniform1i(glGetUniformLocation(iPlaneShader, "noOfVPLs"), vpls.size());
 		glUniform1i(glGetUniformLocation(iPlaneShader, "noOfLights"), noOfLights);
 		glUniform1i(glGetUniformLocation(iPlaneShader, "iHistorySize"), iHistorySize);
 		glUniform1i(glGetUniformLocation(iPlaneShader, "iHistoryIndex"), iHistoryIndex);
 		glUniform1i(glGetUniformLocation(iPlaneShader, "noOfVPLBounces"), noOfVPLBounces);
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gPosition);
+		glBindTexture(GL_TEXTURE_2D, shadePosition);
 		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, gNormal);
+		glBindTexture(GL_TEXTURE_2D, shadeNormal);
 		glActiveTexture(GL_TEXTURE4);
-		glBindTexture(GL_TEXTURE_2D_ARRAY, vMasks);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, shadeMasks);
+		glActiveTexture(GL_TEXTURE5);
+		glBindTexture(GL_TEXTURE_BUFFER, lightTreeTexture);
+		glActiveTexture(GL_TEXTURE6);
+		glBindTexture(GL_TEXTURE_2D, ismAtlas);
 		glBindVertexArray(dPlaneVAO);
 		glDrawArrays(GL_TRIANGLES, 0, 6);
 
-		glFinish();
-		intervalEnd = SDL_GetTicks();
-		indirectColorIA = ((indirectColorIA * noOfFrames) + intervalEnd - intervalStart) / (noOfFrames + 1);
-		intervalStart = intervalEnd;
+		Profiler::endGL(indirectColorStage);
 
 		if (discWeights.size() > 1) {
+			Profiler::beginGL(indirectDiscontinuityStage);
 			glBindFramebuffer(GL_FRAMEBUFFER, discBuffer1);
 			glUseProgram(discShader);
 			for (int i = 0; i < discWeights.size(); ++i)
@@ -1198,11 +1875,11 @@ void renderer::update(float deltaTime) {
 			glUniform1i(glGetUniformLocation(discShader, "pass"), 1);
 			glUniform1i(glGetUniformLocation(discShader, "iss"), interleavedSamplingSize);
 			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, gNormal);
+			glBindTexture(GL_TEXTURE_2D, shadeNormal);
 			glActiveTexture(GL_TEXTURE1);
 			glBindTexture(GL_TEXTURE_2D, iColor);
 			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, gPosition);
+			glBindTexture(GL_TEXTURE_2D, shadePosition);
 			glBindVertexArray(dPlaneVAO);
 			glDrawArrays(GL_TRIANGLES, 0, 6);
 
@@ -1215,10 +1892,7 @@ void renderer::update(float deltaTime) {
 
 			iHistoryIndex = (iHistoryIndex + 1) % iHistorySize;
 
-			glFinish();
-			intervalEnd = SDL_GetTicks();
-			indirectDiscontinuityIA = ((indirectDiscontinuityIA * noOfFrames) + intervalEnd - intervalStart) / (noOfFrames + 1);
-			intervalStart = intervalEnd;
+			Profiler::endGL(indirectDiscontinuityStage);
 
 			glCopyImageSubData(discIndirect2, GL_TEXTURE_2D, 0, 0, 0, 0, iHistory, GL_TEXTURE_2D_ARRAY, 0, 0, 0, iHistoryIndex, iWidth, iHeight, 1);
 		}
@@ -1226,10 +1900,11 @@ void renderer::update(float deltaTime) {
 			iHistoryIndex = (iHistoryIndex + 1) % iHistorySize;
 			glCopyImageSubData(iColor, GL_TEXTURE_2D, 0, 0, 0, 0, iHistory, GL_TEXTURE_2D_ARRAY, 0, 0, 0, iHistoryIndex, iWidth, iHeight, 1);
 		}
-		glCopyImageSubData(gPosition, GL_TEXTURE_2D, 0, 0, 0, 0, pHistory, GL_TEXTURE_2D_ARRAY, 0, 0, 0, iHistoryIndex, p_width, p_height, 1);
-		viewHistory[iHistoryIndex] = view;
+		glCopyImageSubData(shadePosition, GL_TEXTURE_2D, 0, 0, 0, 0, pHistory, GL_TEXTURE_2D_ARRAY, 0, 0, 0, iHistoryIndex, p_width, p_height, 1);
+		viewHistory[iHistoryIndex] = pipelinedIndirect ? shadeView : view;
 	}
 
+	Profiler::beginGL(indirectReprojectionStage);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glUseProgram(iHistoryShader);
 	glClear(GL_COLOR_BUFFER_BIT);
@@ -1259,12 +1934,26 @@ void renderer::update(float deltaTime) {
 	}
 	glActiveTexture(GL_TEXTURE3);
 	glBindTexture(GL_TEXTURE_2D, gAlbedo);
+	//Only frames that shaded a new slice are added, once the history holds nothing from before the view stopped
+	if (stillFrames > iHistorySize && indirectUpdate) {
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, accumBuffer);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glUniform1i(glGetUniformLocation(iHistoryShader, "pass"), 1);
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+		glDisable(GL_BLEND);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		accumulatedFrames++;
+	}
+	glUniform1i(glGetUniformLocation(iHistoryShader, "pass"), accumulatedFrames > 0 ? 2 : 0);
+	glUniform1i(glGetUniformLocation(iHistoryShader, "accumulated"), 4);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, accumColor);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 
-	glFinish();
-	intervalEnd = SDL_GetTicks();
-	indirectReprojectionIA = ((indirectReprojectionIA * noOfFrames) + intervalEnd - intervalStart) / (noOfFrames + 1);
-	intervalStart = intervalEnd;
+	Profiler::endGL(indirectReprojectionStage);
 	noOfFrames++;
 
 	if (vplDebugEnabled) {
@@ -1276,21 +1965,72 @@ void renderer::update(float deltaTime) {
 		glBindVertexArray(vpl_vao);
 		glDrawArrays(GL_LINES, 0, vpls.size() * 2);
 	}
+
+	HUD::addFrameTime(deltaTime * 1000);
+	if (hudEnabled) {
+		Profiler::beginGL(hudStage);
+		double rays = Profiler::getLatestCount(vplValidationRaysCounter) + Profiler::getLatestCount(vplShootingRaysCounter) + Profiler::getLatestCount(indirectRaysCounter) + Profiler::getLatestCount(indirectTileRaysCounter);
+		HUD::draw(hudStages, noOfVPLS, noOfInvalidVPLs, rays);
+		Profiler::endGL(hudStage);
+	}
+	endFrameSlot();
 }
 
 std::string renderer::getTimeIntervals() {
 	std::stringstream intervals;
-	intervals << "VPL Intersection Tests : " << vplIntersectionIA << std::endl;
-	intervals << "VPL Shooting : " << vplShootingIA << std::endl;
-	intervals << "Direct Shadow Cubemaps : " << directShadowIA << std::endl;
-	intervals << "G-Buffer : " << gBufferIA << std::endl;
-	intervals << "Direct Shading : " << directColorIA << std::endl;
-	intervals << "Indirect Intersection Tests : " << indirectIntersectionIA << std::endl;
-	intervals << "Indirect Shading : " << indirectColorIA << std::endl;
-	intervals << "Indirect Discontinuity : " << indirectDiscontinuityIA << std::endl;
-	intervals << "Indirect Reprojection : " << indirectReprojectionIA << std::endl;
+	if (Profiler::getNoOfStages() == 0)
+		return intervals.str();
+	for (unsigned int stage = vplIntersectionStage; stage <= indirectReprojectionStage; ++stage)
+		intervals << Profiler::getName(stage) << " : " << Profiler::getAverage(stage) << std::endl;
+	if (visibilityBackend == VISIBILITY_SHARED_ORIGIN)
+		intervals << Profiler::getName(bvhRefitStage) << " : " << Profiler::getAverage(bvhRefitStage) << std::endl;
+	if (rayStatsEnabled) {
+		float hitRate = indirectRaysTracedIA > 0 ? indirectRaysOccludedIA / indirectRaysTracedIA : 0;
+		intervals << "Indirect Ray Candidates : " << indirectRayCandidatesIA << std::endl;
+		intervals << "Indirect Rays Traced : " << indirectRaysTracedIA << std::endl;
+		intervals << "Indirect Rays Culled : " << indirectRayCandidatesIA - indirectRaysTracedIA << std::endl;
+		intervals << "Indirect Ray Hit Rate : " << hitRate << std::endl;
+		if (adaptiveEnabled)
+			intervals << "Indirect Tile Rays Traced : " << indirectTileRaysIA << std::endl;
+	}
+	double validationRays = Profiler::getCounterTotal(vplValidationRaysCounter);
+	double shootingRays = Profiler::getCounterTotal(vplShootingRaysCounter);
+	if (validationRays > 0)
+		intervals << "VPL Validation Occlusion Ratio : " << Profiler::getCounterTotal(vplValidationOccludedCounter) / validationRays << std::endl;
+	if (shootingRays > 0)
+		intervals << "VPL Shooting Hit Ratio : " << Profiler::getCounterTotal(vplShootingHitsCounter) / shootingRays << std::endl;
+	if (progressiveEnabled)
+		intervals << "Progressive Frames Accumulated : " << accumulatedFrames << std::endl;
+	if (Budget::isEnabled()) {
+		intervals << "Budget VPL Generation Per Frame : " << Budget::getVPLGenPerFrame() << std::endl;
+		intervals << "Budget Indirect Interval : " << Budget::getIndirectInterval() << std::endl;
+	}
 	return intervals.str();
 }
 
 void renderer::destroy() {
+	VPLWorker::destroy();
+	clFinish(clQueue);
+	glFinish();
+	for (unsigned int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		if (frameFences[i])
+			glDeleteSync(frameFences[i]);
+		if (gBufferFences[i])
+			glDeleteSync(gBufferFences[i]);
+		if (rayCounterEvents[i])
+			clReleaseEvent(rayCounterEvents[i]);
+	}
+	if (vplWriteEvent)
+		clReleaseEvent(vplWriteEvent);
+	for (unsigned int c = 0; c < 2; ++c) {
+		clReleaseMemObject(clMaskCache[c]);
+		clReleaseMemObject(clMaskCachePositions[c]);
+	}
+	clReleaseMemObject(clVPLStamps);
+	if (traceEvent)
+		clReleaseEvent(traceEvent);
+	if (shadeEvent)
+		clReleaseEvent(shadeEvent);
+	HUD::destroy();
+	Profiler::destroy();
 }
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "resources.h"
+
+namespace {
+struct Resource {
+	std::string subsystem;
+	std::string name;
+	std::string kind;
+	std::string format;
+	size_t bytes;
+};
+
+std::vector<Resource> resources;
+size_t resourcesTotal = 0;
+size_t resourcesBudget = 0;
+
+//Nominal bytes per texel, drivers may pad three channel and 24 bit depth formats
+unsigned int getTexelSize(GLenum format) {
+	switch (format) {
+	case GL_RED:
+	case GL_R8:
+		return 1;
+	case GL_RGB:
+	case GL_RGB8:
+		return 3;
+	case GL_RGBA:
+	case GL_RGBA8:
+	case GL_R32F:
+	case GL_DEPTH_COMPONENT:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32F:
+		return 4;
+	case GL_RGB16F:
+		return 6;
+	case GL_RGBA16F:
+		return 8;
+	case GL_RGB32F:
+		return 12;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		return 4;
+	}
+}
+
+std::string getFormatName(GLenum format) {
+	switch (format) {
+	case GL_RED: return "RED";
+	case GL_R8: return "R8";
+	case GL_RGB: return "RGB";
+	case GL_RGB8: return "RGB8";
+	case GL_RGBA: return "RGBA";
+	case GL_RGBA8: return "RGBA8";
+	case GL_R32F: return "R32F";
+	case GL_DEPTH_COMPONENT: return "DEPTH";
+	case GL_DEPTH_COMPONENT24: return "DEPTH24";
+	case GL_DEPTH_COMPONENT32F: return "DEPTH32F";
+	case GL_RGB16F: return "RGB16F";
+	case GL_RGBA16F: return "RGBA16F";
+	case GL_RGB32F: return "RGB32F";
+	case GL_RGBA32F: return "RGBA32F";
+	default: {
+		std::stringstream name;
+		name << "0x" << std::hex << format;
+		return name.str();
+	}
+	}
+}
+
+std::string formatBytes(size_t bytes) {
+	std::stringstream s;
+	s << std::fixed << std::setprecision(2) << bytes / (1024.0 * 1024.0) << " MB";
+	return s.str();
+}
+}
+
+//The budget comes from the config in megabytes, otherwise from the device's global memory
+void Resources::init(INIReader config, cl_device_id device) {
+	resources.clear();
+	resourcesTotal = 0;
+	resourcesBudget = (size_t)config.GetInteger("resources", "budget", 0) * 1024 * 1024;
+	if (resourcesBudget == 0) {
+		cl_ulong globalMemory = 0;
+		if (clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemory, NULL) == CL_SUCCESS)
+			resourcesBudget = globalMemory;
+	}
+}
+
+void Resources::add(const std::string& subsystem, const std::string& name, const std::string& kind, const std::string& format, size_t bytes) {
+	auto it = std::find_if(resources.begin(), resources.end(), [&](const Resource& r) {
+		return r.subsystem == subsystem && r.name == name;
+	});
+	size_t previous = it != resources.end() ? it->bytes : 0;
+	if (resourcesBudget > 0 && bytes > previous && resourcesTotal - previous + bytes > resourcesBudget)
+		std::cerr << "Warning: allocating " << subsystem << "/" << name << " (" << formatBytes(bytes) << ") exceeds the memory budget, "
+			<< formatBytes(resourcesTotal - previous + bytes) << " of " << formatBytes(resourcesBudget) << std::endl;
+
+	resourcesTotal = resourcesTotal - previous + bytes;
+	if (it != resources.end()) {
+		it->kind = kind;
+		it->format = format;
+		it->bytes = bytes;
+	}
+	else {
+		resources.push_back({ subsystem, name, kind, format, bytes });
+	}
+}
+
+void Resources::addTexture(const std::string& subsystem, const std::string& name, GLenum format, unsigned int width, unsigned int height, unsigned int layers) {
+	std::stringstream description;
+	description << getFormatName(format) << " " << width << "x" << height;
+	if (layers > 1)
+		description << "x" << layers;
+	add(subsystem, name, "GL texture", description.str(), (size_t)width * height * layers * getTexelSize(format));
+}
+
+void Resources::addRenderbuffer(const std::string& subsystem, const std::string& name, GLenum format, unsigned int width, unsigned int height) {
+	std::stringstream description;
+	description << getFormatName(format) << " " << width << "x" << height;
+	add(subsystem, name, "GL renderbuffer", description.str(), (size_t)width * height * getTexelSize(format));
+}
+
+void Resources::addBuffer(const std::string& subsystem, const std::string& name, const std::string& kind, size_t bytes) {
+	add(subsystem, name, kind, "linear", bytes);
+}
+
+size_t Resources::getTotal() {
+	return resourcesTotal;
+}
+
+size_t Resources::getBudget() {
+	return resourcesBudget;
+}
+
+//Subsystems largest first, with every resource listed beneath them when detailed
+std::string Resources::getSummary(bool detailed) {
+	std::map<std::string, size_t> totals;
+	for (const auto& r : resources)
+		totals[r.subsystem] += r.bytes;
+	std::vector<std::pair<std::string, size_t>> subsystems(totals.begin(), totals.end());
+	std::stable_sort(subsystems.begin(), subsystems.end(), [](const std::pair<std::string, size_t>& a, const std::pair<std::string, size_t>& b) {
+		return a.second > b.second;
+	});
+
+	std::stringstream summary;
+	summary << "Memory : " << formatBytes(resourcesTotal);
+	if (resourcesBudget > 0)
+		summary << " of " << formatBytes(resourcesBudget);
+	summary << std::endl;
+	for (const auto& subsystem : subsystems) {
+		summary << "  " << subsystem.first << " : " << formatBytes(subsystem.second) << std::endl;
+		if (!detailed)
+			continue;
+		for (const auto& r : resources)
+			if (r.subsystem == subsystem.first)
+				summary << "    " << r.name << " (" << r.kind << ", " << r.format << ") : " << formatBytes(r.bytes) << std::endl;
+	}
+	return summary.str();
+}
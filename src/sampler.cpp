@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <array>
+
+#include "sampler.h"
+
+namespace {
+constexpr unsigned int primes[SAMPLER_MAX_DIMENSIONS] = { 2, 3, 5, 7 };
+constexpr double primeInverses[SAMPLER_MAX_DIMENSIONS] = { 1.0 / 2, 1.0 / 3, 1.0 / 5, 1.0 / 7 };
+
+typedef std::array<std::array<uint32_t, 32>, SAMPLER_MAX_DIMENSIONS> Directions;
+
+//Direction vectors from the Joe-Kuo primitive polynomials, the first dimension is the van der Corput sequence
+constexpr Directions buildDirections() {
+	const uint32_t degrees[SAMPLER_MAX_DIMENSIONS] = { 0, 1, 2, 3 };
+	const uint32_t coefficients[SAMPLER_MAX_DIMENSIONS] = { 0, 0, 1, 1 };
+	const uint32_t initial[SAMPLER_MAX_DIMENSIONS][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 } };
+	Directions v = {};
+	for (unsigned int k = 0; k < 32; ++k)
+		v[0][k] = 1u << (31 - k);
+	for (unsigned int d = 1; d < SAMPLER_MAX_DIMENSIONS; ++d) {
+		uint32_t s = degrees[d];
+		for (unsigned int k = 0; k < 32; ++k) {
+			if (k < s) {
+				v[d][k] = initial[d][k] << (31 - k);
+				continue;
+			}
+			v[d][k] = v[d][k - s] ^ (v[d][k - s] >> s);
+			for (unsigned int j = 1; j < s; ++j)
+				if ((coefficients[d] >> (s - 1 - j)) & 1)
+					v[d][k] ^= v[d][k - j];
+		}
+	}
+	return v;
+}
+
+constexpr Directions directions = buildDirections();
+
+uint32_t hash(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+//24 bits keep the float strictly below one
+float toFloat(uint32_t x) {
+	return (x >> 8) * (1.f / (1 << 24));
+}
+
+float sample(const Sampler::Sequence& sequence, unsigned int d) {
+	if (sequence.type == SAMPLER_SOBOL)
+		return toFloat(sequence.sobol[d] ^ sequence.scramble[d]);
+	//Cranley-Patterson rotation, Halton digits cannot be xor scrambled
+	double x = sequence.halton[d] + sequence.scramble[d] * (1.0 / 4294967296.0);
+	return toFloat(uint32_t((x < 1 ? x : x - 1) * 4294967296.0));
+}
+
+void advance(Sampler::Sequence& sequence, unsigned int dimensions) {
+	if (sequence.type == SAMPLER_SOBOL) {
+		unsigned int bit = __builtin_ctz(sequence.index + 1);
+		for (unsigned int d = 0; d < dimensions; ++d)
+			sequence.sobol[d] ^= directions[d][bit];
+	}
+	else {
+		//Adds one to the reversed digits without recomputing them
+		for (unsigned int d = 0; d < dimensions; ++d) {
+			double inv = primeInverses[d];
+			double r = 1 - sequence.halton[d] - 1e-10;
+			if (inv < r) {
+				sequence.halton[d] += inv;
+			}
+			else {
+				double h = inv, hh;
+				do {
+					hh = h;
+					h *= inv;
+				} while (h >= r);
+				sequence.halton[d] += hh + h - 1;
+			}
+		}
+	}
+	sequence.index++;
+}
+}
+
+double Sampler::radicalInverse(unsigned int dimension, uint32_t i) {
+	unsigned int base = primes[dimension];
+	double inv = primeInverses[dimension];
+	double f = inv, r = 0;
+	while (i > 0) {
+		r += (i % base) * f;
+		i /= base;
+		f *= inv;
+	}
+	return r;
+}
+
+Sampler::Sequence Sampler::create(unsigned int type, uint32_t seed, uint32_t start) {
+	Sequence sequence;
+	sequence.type = type;
+	for (unsigned int d = 0; d < SAMPLER_MAX_DIMENSIONS; ++d)
+		sequence.scramble[d] = seed ? hash(seed * SAMPLER_MAX_DIMENSIONS + d) : 0;
+	skipTo(sequence, start);
+	return sequence;
+}
+
+void Sampler::skipTo(Sequence& sequence, uint32_t index) {
+	sequence.index = index;
+	uint32_t gray = index ^ (index >> 1);
+	for (unsigned int d = 0; d < SAMPLER_MAX_DIMENSIONS; ++d) {
+		sequence.halton[d] = radicalInverse(d, index);
+		sequence.sobol[d] = 0;
+		for (unsigned int k = 0; k < 32; ++k)
+			if ((gray >> k) & 1)
+				sequence.sobol[d] ^= directions[d][k];
+	}
+}
+
+//Every dimension advances together so later calls can ask for more dimensions than earlier ones
+void Sampler::next(Sequence& sequence, unsigned int dimensions, float* out) {
+	dimensions = std::min(dimensions, (unsigned int)SAMPLER_MAX_DIMENSIONS);
+	for (unsigned int d = 0; d < dimensions; ++d)
+		out[d] = sample(sequence, d);
+	advance(sequence, SAMPLER_MAX_DIMENSIONS);
+}
+
+void Sampler::generate(Sequence& sequence, unsigned int n, unsigned int dimensions, float* out) {
+	dimensions = std::min(dimensions, (unsigned int)SAMPLER_MAX_DIMENSIONS);
+	for (unsigned int i = 0; i < n; ++i) {
+		for (unsigned int d = 0; d < dimensions; ++d)
+			out[d * n + i] = sample(sequence, d);
+		advance(sequence, SAMPLER_MAX_DIMENSIONS);
+	}
+}
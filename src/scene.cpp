@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include "scene.h"
+
+#define SCENE_WALL_INSET 0.05f
+#define SCENE_MAX_LIGHTS 16
+
+namespace {
+struct Dimensions {
+	unsigned int rooms;
+	unsigned int roomsPerRow;
+	float roomSize;
+	float roomHeight;
+	unsigned int pillars;
+	unsigned int pillarSegments;
+	unsigned int subdivisions;
+};
+
+Dimensions getDimensions(INIReader config) {
+	Dimensions d;
+	d.rooms = std::max(1l, config.GetInteger("synthetic", "rooms", 1));
+	d.roomsPerRow = (unsigned int)std::ceil(std::sqrt((float)d.rooms));
+	d.roomSize = config.GetReal("synthetic", "roomSize", 10);
+	d.roomHeight = config.GetReal("synthetic", "roomHeight", 4);
+	d.pillars = std::max(0l, config.GetInteger("synthetic", "pillars", 4));
+	d.pillarSegments = std::max(3l, config.GetInteger("synthetic", "pillarSegments", 8));
+	d.subdivisions = std::max(1l, config.GetInteger("synthetic", "subdivisions", 4));
+	return d;
+}
+
+glm::vec3 getRoomCentre(const Dimensions& d, unsigned int room) {
+	float offset = (d.roomsPerRow - 1) * 0.5f;
+	return glm::vec3((room % d.roomsPerRow - offset) * d.roomSize, 0, (room / d.roomsPerRow - offset) * d.roomSize);
+}
+
+void addVertex(tinyobj::attrib_t& attrib, tinyobj::shape_t& shape, glm::vec3 position, glm::vec3 normal, glm::vec2 texCoord) {
+	tinyobj::index_t index;
+	index.vertex_index = attrib.vertices.size() / 3;
+	index.normal_index = attrib.normals.size() / 3;
+	index.texcoord_index = attrib.texcoords.size() / 2;
+	attrib.vertices.insert(attrib.vertices.end(), { position.x, position.y, position.z });
+	attrib.colors.insert(attrib.colors.end(), { 1, 1, 1 });
+	attrib.normals.insert(attrib.normals.end(), { normal.x, normal.y, normal.z });
+	attrib.texcoords.insert(attrib.texcoords.end(), { texCoord.x, texCoord.y });
+	shape.mesh.indices.push_back(index);
+}
+
+void addTriangle(tinyobj::attrib_t& attrib, tinyobj::shape_t& shape, glm::vec3 normal, glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec2 ta, glm::vec2 tb, glm::vec2 tc) {
+	addVertex(attrib, shape, a, normal, ta);
+	addVertex(attrib, shape, b, normal, tb);
+	addVertex(attrib, shape, c, normal, tc);
+	shape.mesh.num_face_vertices.push_back(3);
+}
+
+//Rectangle from origin spanning u and v, split into subdivisions^2 cells; door skips the lower middle cells
+void addPanel(tinyobj::attrib_t& attrib, tinyobj::shape_t& shape, glm::vec3 origin, glm::vec3 u, glm::vec3 v, unsigned int subdivisions, bool door) {
+	glm::vec3 normal = glm::normalize(glm::cross(u, v));
+	glm::vec2 repeats = glm::vec2(glm::length(u), glm::length(v)) / 2.f;
+	for (unsigned int j = 0; j < subdivisions; ++j) {
+		for (unsigned int i = 0; i < subdivisions; ++i) {
+			if (door && subdivisions >= 3 && i == subdivisions / 2 && j < (subdivisions + 1) / 2)
+				continue;
+			float u0 = i / (float)subdivisions, u1 = (i + 1) / (float)subdivisions;
+			float v0 = j / (float)subdivisions, v1 = (j + 1) / (float)subdivisions;
+			glm::vec3 p00 = origin + u0 * u + v0 * v;
+			glm::vec3 p10 = origin + u1 * u + v0 * v;
+			glm::vec3 p11 = origin + u1 * u + v1 * v;
+			glm::vec3 p01 = origin + u0 * u + v1 * v;
+			glm::vec2 t00 = glm::vec2(u0, v0) * repeats;
+			glm::vec2 t10 = glm::vec2(u1, v0) * repeats;
+			glm::vec2 t11 = glm::vec2(u1, v1) * repeats;
+			glm::vec2 t01 = glm::vec2(u0, v1) * repeats;
+			addTriangle(attrib, shape, normal, p00, p10, p11, t00, t10, t11);
+			addTriangle(attrib, shape, normal, p00, p11, p01, t00, t11, t01);
+		}
+	}
+}
+
+void addPillar(tinyobj::attrib_t& attrib, tinyobj::shape_t& shape, glm::vec3 base, float radius, float height, unsigned int segments, unsigned int stacks) {
+	const float pi = 3.14159265f;
+	for (unsigned int s = 0; s < segments; ++s) {
+		float a0 = 2 * pi * s / segments, a1 = 2 * pi * (s + 1) / segments;
+		glm::vec3 n0 = glm::vec3(std::cos(a0), 0, std::sin(a0));
+		glm::vec3 n1 = glm::vec3(std::cos(a1), 0, std::sin(a1));
+		glm::vec3 normal = glm::normalize(n0 + n1);
+		for (unsigned int k = 0; k < stacks; ++k) {
+			float y0 = height * k / stacks, y1 = height * (k + 1) / stacks;
+			glm::vec3 p00 = base + n0 * radius + glm::vec3(0, y0, 0);
+			glm::vec3 p10 = base + n1 * radius + glm::vec3(0, y0, 0);
+			glm::vec3 p11 = base + n1 * radius + glm::vec3(0, y1, 0);
+			glm::vec3 p01 = base + n0 * radius + glm::vec3(0, y1, 0);
+			glm::vec2 t00 = glm::vec2(s / (float)segments, y0 / height);
+			glm::vec2 t10 = glm::vec2((s + 1) / (float)segments, y0 / height);
+			glm::vec2 t11 = glm::vec2((s + 1) / (float)segments, y1 / height);
+			glm::vec2 t01 = glm::vec2(s / (float)segments, y1 / height);
+			addTriangle(attrib, shape, normal, p00, p11, p10, t00, t11, t10);
+			addTriangle(attrib, shape, normal, p00, p01, p11, t00, t01, t11);
+		}
+	}
+}
+
+tinyobj::shape_t createShape(const std::string& name) {
+	tinyobj::shape_t shape;
+	shape.name = name;
+	return shape;
+}
+
+//Materials are handed out round-robin over the shapes
+void addShape(std::vector<tinyobj::shape_t>& shapes, tinyobj::shape_t& shape, unsigned int noOfMaterials) {
+	shape.mesh.material_ids.assign(shape.mesh.num_face_vertices.size(), shapes.size() % noOfMaterials);
+	shapes.push_back(shape);
+}
+}
+
+bool Scene::isEnabled(INIReader config) {
+	return config.GetBoolean("synthetic", "enabled", false);
+}
+
+void Scene::generate(INIReader config, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& mats) {
+	Dimensions d = getDimensions(config);
+	unsigned int noOfMaterials = std::max(1l, config.GetInteger("synthetic", "materials", 4));
+	unsigned int texturedMaterials = std::min((unsigned int)std::max(0l, config.GetInteger("synthetic", "texturedMaterials", 0)), noOfMaterials);
+	unsigned int textureSize = std::max(4l, config.GetInteger("synthetic", "textureSize", 256)) / 4 * 4;
+
+	std::mt19937 generator(config.GetInteger("synthetic", "seed", 1337));
+	std::uniform_real_distribution<float> distribution(0.2f, 0.9f);
+	for (unsigned int m = 0; m < noOfMaterials; ++m) {
+		tinyobj::material_t mat;
+		mat.name = "synthetic" + std::to_string(m);
+		for (int c = 0; c < 3; ++c) {
+			mat.ambient[c] = 0;
+			mat.diffuse[c] = distribution(generator);
+			mat.specular[c] = 0;
+			mat.transmittance[c] = 0;
+			mat.emission[c] = 0;
+		}
+		mat.shininess = 1;
+		mat.ior = 1;
+		mat.dissolve = 1;
+		mat.illum = 1;
+		if (m < texturedMaterials)
+			mat.diffuse_texname = "synthetic:" + std::to_string(m) + ":" + std::to_string(textureSize);
+		mats.push_back(mat);
+	}
+
+	float half = d.roomSize * 0.5f - SCENE_WALL_INSET;
+	float pillarRadius = d.roomSize * 0.03f;
+	unsigned int pillarsPerRow = (unsigned int)std::ceil(std::sqrt((float)d.pillars));
+	for (unsigned int r = 0; r < d.rooms; ++r) {
+		glm::vec3 c = getRoomCentre(d, r);
+		glm::vec3 x = glm::vec3(2 * half, 0, 0);
+		glm::vec3 y = glm::vec3(0, d.roomHeight, 0);
+		glm::vec3 z = glm::vec3(0, 0, 2 * half);
+		std::string room = "room" + std::to_string(r);
+
+		//Panels wind so their normals face into the room
+		tinyobj::shape_t floor = createShape(room + "_floor");
+		addPanel(attrib, floor, c + glm::vec3(-half, 0, -half), z, x, d.subdivisions, false);
+		addShape(shapes, floor, noOfMaterials);
+
+		tinyobj::shape_t ceiling = createShape(room + "_ceiling");
+		addPanel(attrib, ceiling, c + glm::vec3(-half, d.roomHeight, -half), x, z, d.subdivisions, false);
+		addShape(shapes, ceiling, noOfMaterials);
+
+		tinyobj::shape_t walls = createShape(room + "_walls");
+		addPanel(attrib, walls, c + glm::vec3(-half, 0, -half), x, y, d.subdivisions, true);
+		addPanel(attrib, walls, c + glm::vec3(half, 0, half), -x, y, d.subdivisions, true);
+		addPanel(attrib, walls, c + glm::vec3(-half, 0, half), -z, y, d.subdivisions, true);
+		addPanel(attrib, walls, c + glm::vec3(half, 0, -half), z, y, d.subdivisions, true);
+		addShape(shapes, walls, noOfMaterials);
+
+		for (unsigned int p = 0; p < d.pillars; ++p) {
+			glm::vec3 base = c + glm::vec3(
+				((p % pillarsPerRow + 1) / (float)(pillarsPerRow + 1) - 0.5f) * 2 * half,
+				0,
+				((p / pillarsPerRow + 1) / (float)(pillarsPerRow + 1) - 0.5f) * 2 * half
+			);
+			tinyobj::shape_t pillar = createShape(room + "_pillar" + std::to_string(p));
+			addPillar(attrib, pillar, base, pillarRadius, d.roomHeight, d.pillarSegments, d.subdivisions);
+			addShape(shapes, pillar, noOfMaterials);
+		}
+	}
+
+	std::cout << "Synthetic scene: " << d.rooms << " rooms, " << shapes.size() << " meshes, " << attrib.vertices.size() / 9 << " triangles, " << noOfMaterials << " materials (" << texturedMaterials << " textured)" << std::endl;
+}
+
+void Scene::generateLights(INIReader config, std::vector<Light>& pls, std::vector<LightExtra>& plexs) {
+	Dimensions d = getDimensions(config);
+	float intensity = config.GetReal("synthetic", "lightIntensity", 100);
+	unsigned int counts[3] = {
+		(unsigned int)std::max(0l, config.GetInteger("synthetic", "pointLights", 1)),
+		(unsigned int)std::max(0l, config.GetInteger("synthetic", "spotLights", 0)),
+		(unsigned int)std::max(0l, config.GetInteger("synthetic", "areaLights", 0))
+	};
+
+	unsigned int noOfLights = counts[0] + counts[1] + counts[2];
+	if (noOfLights == 0) {
+		std::cerr << "Synthetic scene has no lights, adding a point light" << std::endl;
+		counts[0] = noOfLights = 1;
+	}
+	if (noOfLights > SCENE_MAX_LIGHTS) {
+		std::cerr << "Synthetic scene asks for " << noOfLights << " lights, only the first " << SCENE_MAX_LIGHTS << " are used" << std::endl;
+		noOfLights = SCENE_MAX_LIGHTS;
+	}
+
+	//Lights go round the rooms below the ceiling, circling the centre once every room has one
+	unsigned int i = 0;
+	for (unsigned int type = 0; type < 3; ++type) {
+		for (unsigned int n = 0; n < counts[type] && i < noOfLights; ++n, ++i) {
+			unsigned int lap = i / d.rooms;
+			float angle = lap * 2.39996f;
+			float radius = lap ? d.roomSize * 0.2f : 0;
+			glm::vec3 position = getRoomCentre(d, i % d.rooms) + glm::vec3(std::cos(angle) * radius, d.roomHeight - 0.5f, std::sin(angle) * radius);
+
+			Light pl;
+			pl.position = glm::vec4(position, 1);
+			pl.diffuse = glm::vec4(intensity, intensity, intensity, 1);
+			pl.specular = pl.diffuse;
+			pl.normal = glm::vec4(0, -1, 0, 0);
+			pls.push_back(pl);
+
+			LightExtra plex;
+			plex.type = type;
+			plex.quad = glm::vec2(d.roomSize * 0.25f);
+			plex.angle = 0.78f;
+			plexs.push_back(plex);
+		}
+	}
+}
+
+bool Scene::isTexture(const std::string& name) {
+	return name.compare(0, 10, "synthetic:") == 0;
+}
+
+SDL_Surface* Scene::createTexture(const std::string& name) {
+	size_t split = name.find(':', 10);
+	unsigned int material = std::stoi(name.substr(10, split - 10));
+	unsigned int size = split == std::string::npos ? 256 : std::stoi(name.substr(split + 1));
+
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, size, size, 24, SDL_PIXELFORMAT_RGB24);
+	if (!surface) {
+		std::cerr << "Failed to create synthetic texture " << name << ": " << SDL_GetError() << std::endl;
+		return NULL;
+	}
+
+	//Checker whose cell size and tint change per material, so mip levels and cache footprint differ too
+	std::mt19937 generator(material);
+	std::uniform_int_distribution<int> distribution(64, 255);
+	Uint8 a[3] = { (Uint8)distribution(generator), (Uint8)distribution(generator), (Uint8)distribution(generator) };
+	Uint8 b[3] = { (Uint8)(a[0] / 3), (Uint8)(a[1] / 3), (Uint8)(a[2] / 3) };
+	unsigned int cell = std::max(1u, size >> (2 + material % 4));
+	for (unsigned int y = 0; y < size; ++y) {
+		Uint8* row = (Uint8*)surface->pixels + y * surface->pitch;
+		for (unsigned int x = 0; x < size; ++x) {
+			Uint8* colour = ((x / cell + y / cell) & 1) ? a : b;
+			row[x * 3 + 0] = colour[0];
+			row[x * 3 + 1] = colour[1];
+			row[x * 3 + 2] = colour[2];
+		}
+	}
+	return surface;
+}
@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "vpl.h"
+
+#define VPL_LANES 4
+
+namespace RR = RadeonRays;
+
+namespace {
+//Parents of the VPLs in a range sit at i - offset in these arrays, type is null above the first bounce
+struct Parents {
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* nx;
+	const float* ny;
+	const float* nz;
+	const float* invHypSin;
+	const int* type;
+	unsigned int offset;
+};
+
+unsigned int padded(unsigned int n) {
+	return (n + VPL_LANES - 1) / VPL_LANES * VPL_LANES;
+}
+
+//1 / sin of the angle between the light normal and straight down, 0 when the light faces straight down
+float getInvHypSin(float ny) {
+	float s = 1 - ny * ny;
+	return s > 1e-12f ? 1 / std::sqrt(s) : 0;
+}
+
+//Closed form of the acos/sin construction, cosine is between the light normal and the direction to the VPL
+float getQuadDistance(float cosine, float length, float invHypSin) {
+	if (invHypSin > 0)
+		return std::sqrt(std::max(1 - cosine * cosine, 0.f)) * invHypSin * length;
+	return cosine * length;
+}
+
+RR::ray getRay(const VPL::Store& store, const Parents& p, unsigned int i, float rDelta) {
+	unsigned int j = i - p.offset;
+	float dx = store.x[i] - p.x[j];
+	float dy = store.y[i] - p.y[j];
+	float dz = store.z[i] - p.z[j];
+	float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+	RR::ray r;
+	if (p.type && p.type[j] == 2) {
+		float cosine = (dx * p.nx[j] + dy * p.ny[j] + dz * p.nz[j]) / length;
+		r.o = RR::float4(store.x[i], store.y[i], store.z[i], getQuadDistance(cosine, length, p.invHypSin[j]));
+		r.d = RR::float3(-p.nx[j], -p.ny[j], -p.nz[j]);
+	}
+	else {
+		r.o = RR::float4(p.x[j], p.y[j], p.z[j], length - rDelta);
+		r.d = RR::float4(dx / length, dy / length, dz / length, 0.f);
+	}
+	return r;
+}
+
+void buildRays(const VPL::Store& store, const Parents& p, unsigned int begin, unsigned int end, float rDelta, std::vector<RR::ray>& rays) {
+	unsigned int i = begin;
+#ifdef __SSE2__
+	alignas(16) float o[4][VPL_LANES];
+	alignas(16) float d[3][VPL_LANES];
+	for (; i + VPL_LANES <= end; i += VPL_LANES) {
+		unsigned int j = i - p.offset;
+		__m128 vx = _mm_loadu_ps(&store.x[i]);
+		__m128 vy = _mm_loadu_ps(&store.y[i]);
+		__m128 vz = _mm_loadu_ps(&store.z[i]);
+		__m128 px = _mm_loadu_ps(p.x + j);
+		__m128 py = _mm_loadu_ps(p.y + j);
+		__m128 pz = _mm_loadu_ps(p.z + j);
+		__m128 dx = _mm_sub_ps(vx, px);
+		__m128 dy = _mm_sub_ps(vy, py);
+		__m128 dz = _mm_sub_ps(vz, pz);
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 inv = _mm_div_ps(_mm_set1_ps(1), length);
+		__m128 ox = px, oy = py, oz = pz;
+		__m128 ow = _mm_sub_ps(length, _mm_set1_ps(rDelta));
+		dx = _mm_mul_ps(dx, inv);
+		dy = _mm_mul_ps(dy, inv);
+		dz = _mm_mul_ps(dz, inv);
+		if (p.type) {
+			__m128 quad = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(p.type + j)), _mm_set1_epi32(2)));
+			if (_mm_movemask_ps(quad)) {
+				__m128 nx = _mm_loadu_ps(p.nx + j);
+				__m128 ny = _mm_loadu_ps(p.ny + j);
+				__m128 nz = _mm_loadu_ps(p.nz + j);
+				__m128 ihs = _mm_loadu_ps(p.invHypSin + j);
+				__m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)), _mm_mul_ps(dz, nz));
+				__m128 sine = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1), _mm_mul_ps(cosine, cosine)), _mm_setzero_ps()));
+				__m128 tilted = _mm_cmpgt_ps(ihs, _mm_setzero_ps());
+				__m128 distance = _mm_mul_ps(length, _mm_or_ps(_mm_and_ps(tilted, _mm_mul_ps(sine, ihs)), _mm_andnot_ps(tilted, cosine)));
+				ox = _mm_or_ps(_mm_and_ps(quad, vx), _mm_andnot_ps(quad, ox));
+				oy = _mm_or_ps(_mm_and_ps(quad, vy), _mm_andnot_ps(quad, oy));
+				oz = _mm_or_ps(_mm_and_ps(quad, vz), _mm_andnot_ps(quad, oz));
+				ow = _mm_or_ps(_mm_and_ps(quad, distance), _mm_andnot_ps(quad, ow));
+				__m128 zero = _mm_setzero_ps();
+				dx = _mm_or_ps(_mm_and_ps(quad, _mm_sub_ps(zero, nx)), _mm_andnot_ps(quad, dx));
+				dy = _mm_or_ps(_mm_and_ps(quad, _mm_sub_ps(zero, ny)), _mm_andnot_ps(quad, dy));
+				dz = _mm_or_ps(_mm_and_ps(quad, _mm_sub_ps(zero, nz)), _mm_andnot_ps(quad, dz));
+			}
+		}
+		_mm_store_ps(o[0], ox);
+		_mm_store_ps(o[1], oy);
+		_mm_store_ps(o[2], oz);
+		_mm_store_ps(o[3], ow);
+		_mm_store_ps(d[0], dx);
+		_mm_store_ps(d[1], dy);
+		_mm_store_ps(d[2], dz);
+		for (unsigned int k = 0; k < VPL_LANES; ++k) {
+			RR::ray& r = rays[i + k];
+			r.o = RR::float4(o[0][k], o[1][k], o[2][k], o[3][k]);
+			r.d = RR::float4(d[0][k], d[1][k], d[2][k], 0.f);
+		}
+	}
+#endif
+	for (; i < end; ++i)
+		rays[i] = getRay(store, p, i, rDelta);
+}
+
+//Bit k set when first bounce VPL i + k has left its light's cone or quad
+unsigned int getOutside(const VPL::Store& store, unsigned int i) {
+	unsigned int bits = 0;
+#ifdef __SSE2__
+	__m128 dx = _mm_sub_ps(_mm_loadu_ps(&store.x[i]), _mm_loadu_ps(&store.lx[i]));
+	__m128 dy = _mm_sub_ps(_mm_loadu_ps(&store.y[i]), _mm_loadu_ps(&store.ly[i]));
+	__m128 dz = _mm_sub_ps(_mm_loadu_ps(&store.z[i]), _mm_loadu_ps(&store.lz[i]));
+	__m128 nx = _mm_loadu_ps(&store.lnx[i]);
+	__m128 ny = _mm_loadu_ps(&store.lny[i]);
+	__m128 nz = _mm_loadu_ps(&store.lnz[i]);
+	__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+	__m128 cosine = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)), _mm_mul_ps(dz, nz)), length);
+	__m128i type = _mm_loadu_si128((const __m128i*)&store.lType[i]);
+	__m128 spot = _mm_castsi128_ps(_mm_cmpeq_epi32(type, _mm_set1_epi32(1)));
+	__m128 quad = _mm_castsi128_ps(_mm_cmpeq_epi32(type, _mm_set1_epi32(2)));
+	__m128 outside = _mm_and_ps(spot, _mm_cmplt_ps(cosine, _mm_loadu_ps(&store.lCone[i])));
+	if (_mm_movemask_ps(quad)) {
+		__m128 ihs = _mm_loadu_ps(&store.lInvHypSin[i]);
+		__m128 sine = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1), _mm_mul_ps(cosine, cosine)), _mm_setzero_ps()));
+		__m128 tilted = _mm_cmpgt_ps(ihs, _mm_setzero_ps());
+		__m128 distance = _mm_mul_ps(length, _mm_or_ps(_mm_and_ps(tilted, _mm_mul_ps(sine, ihs)), _mm_andnot_ps(tilted, cosine)));
+		//Drift of the VPL projected back onto the light plane, relative to the light position
+		__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 driftX = _mm_and_ps(absMask, _mm_sub_ps(dx, _mm_mul_ps(nx, distance)));
+		__m128 driftY = _mm_and_ps(absMask, _mm_sub_ps(dz, _mm_mul_ps(nz, distance)));
+		__m128 drifted = _mm_or_ps(_mm_cmpgt_ps(driftX, _mm_loadu_ps(&store.lQuadX[i])), _mm_cmpgt_ps(driftY, _mm_loadu_ps(&store.lQuadY[i])));
+		outside = _mm_or_ps(outside, _mm_and_ps(quad, drifted));
+	}
+	bits = _mm_movemask_ps(outside);
+#else
+	for (unsigned int k = 0; k < VPL_LANES; ++k) {
+		unsigned int j = i + k;
+		float dx = store.x[j] - store.lx[j];
+		float dy = store.y[j] - store.ly[j];
+		float dz = store.z[j] - store.lz[j];
+		float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+		float cosine = (dx * store.lnx[j] + dy * store.lny[j] + dz * store.lnz[j]) / length;
+		bool outside = false;
+		if (store.lType[j] == 1) {
+			outside = cosine < store.lCone[j];
+		}
+		else if (store.lType[j] == 2) {
+			float distance = getQuadDistance(cosine, length, store.lInvHypSin[j]);
+			outside = std::abs(dx - store.lnx[j] * distance) > store.lQuadX[j] || std::abs(dz - store.lnz[j] * distance) > store.lQuadY[j];
+		}
+		bits |= outside << k;
+	}
+#endif
+	return bits;
+}
+}
+
+float VPL::getQuadLightDistance(const Light& pl, const Light& vpl) {
+	glm::vec3 diff = glm::vec3(vpl.position - pl.position);
+	float length = glm::length(diff);
+	return getQuadDistance(glm::dot(diff, glm::vec3(pl.normal)) / length, length, getInvHypSin(pl.normal.y));
+}
+
+//Arrays are padded to whole lanes with zeros, padded lanes produce garbage that is masked off
+void VPL::init(Store& store, unsigned int noOfVPLs, unsigned int noOfVPLBounces) {
+	store.size = noOfVPLs;
+	store.perBounce = noOfVPLs / noOfVPLBounces;
+	for (std::vector<float>* v : { &store.x, &store.y, &store.z, &store.nx, &store.ny, &store.nz, &store.pathDist })
+		v->assign(padded(store.size), 0);
+	for (std::vector<float>* v : { &store.lx, &store.ly, &store.lz, &store.lnx, &store.lny, &store.lnz, &store.lCone, &store.lQuadX, &store.lQuadY, &store.lInvHypSin })
+		v->assign(padded(store.perBounce), 0);
+	store.lType.assign(padded(store.perBounce), 0);
+	store.valid.assign((store.size + 63) / 64, 0);
+	store.dirty.assign((store.size + 63) / 64, ~uint64_t(0));
+}
+
+//Lights move, so the first bounce parents are gathered again every frame
+void VPL::setLights(Store& store, const std::vector<Light>& pls, const std::vector<LightExtra>& plexs) {
+	unsigned int noOfLights = pls.size();
+	for (unsigned int i = 0; i < store.perBounce; ++i) {
+		const Light& pl = pls[i % noOfLights];
+		const LightExtra& plex = plexs[i % noOfLights];
+		if (store.lx[i] != pl.position.x || store.ly[i] != pl.position.y || store.lz[i] != pl.position.z
+			|| store.lnx[i] != pl.normal.x || store.lny[i] != pl.normal.y || store.lnz[i] != pl.normal.z
+			|| store.lCone[i] != plex.angle || store.lQuadX[i] != plex.quad.x || store.lQuadY[i] != plex.quad.y || store.lType[i] != (int)plex.type)
+			setDirty(store, i);
+		store.lx[i] = pl.position.x;
+		store.ly[i] = pl.position.y;
+		store.lz[i] = pl.position.z;
+		store.lnx[i] = pl.normal.x;
+		store.lny[i] = pl.normal.y;
+		store.lnz[i] = pl.normal.z;
+		store.lCone[i] = plex.angle;
+		store.lQuadX[i] = plex.quad.x;
+		store.lQuadY[i] = plex.quad.y;
+		store.lInvHypSin[i] = getInvHypSin(pl.normal.y);
+		store.lType[i] = plex.type;
+	}
+}
+
+//pathDist is the distance travelled since the first bounce, it attenuates the VPLs bounced off this one.
+//The VPL's own ray and the rays of the VPLs bounced off it have to be traced again.
+void VPL::set(Store& store, unsigned int i, const Light& vpl, float pathDist) {
+	setDirty(store, i);
+	if (i + store.perBounce < store.size)
+		setDirty(store, i + store.perBounce);
+	store.x[i] = vpl.position.x;
+	store.y[i] = vpl.position.y;
+	store.z[i] = vpl.position.z;
+	store.nx[i] = vpl.normal.x;
+	store.ny[i] = vpl.normal.y;
+	store.nz[i] = vpl.normal.z;
+	store.pathDist[i] = pathDist;
+}
+
+bool VPL::isValid(const Store& store, unsigned int i) {
+	return (store.valid[i / 64] >> (i % 64)) & 1;
+}
+
+void VPL::setValid(Store& store, unsigned int i, bool valid) {
+	uint64_t bit = uint64_t(1) << (i % 64);
+	if (valid)
+		store.valid[i / 64] |= bit;
+	else
+		store.valid[i / 64] &= ~bit;
+}
+
+bool VPL::isDirty(const Store& store, unsigned int i) {
+	return (store.dirty[i / 64] >> (i % 64)) & 1;
+}
+
+void VPL::setDirty(Store& store, unsigned int i) {
+	store.dirty[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+void VPL::clearDirty(Store& store) {
+	std::fill(store.dirty.begin(), store.dirty.end(), 0);
+}
+
+unsigned int VPL::getNoOfValid(const Store& store) {
+	unsigned int noOfValid = 0;
+	for (uint64_t word : store.valid)
+		noOfValid += __builtin_popcountll(word);
+	return noOfValid;
+}
+
+//One occlusion ray per VPL back towards the light or VPL it bounced off
+void VPL::buildValidationRays(const Store& store, float rDelta, std::vector<RR::ray>& rays) {
+	unsigned int firstBounce = std::min(store.perBounce, store.size);
+	Parents lights = { store.lx.data(), store.ly.data(), store.lz.data(), store.lnx.data(), store.lny.data(), store.lnz.data(), store.lInvHypSin.data(), store.lType.data(), 0 };
+	buildRays(store, lights, 0, firstBounce, rDelta, rays);
+	Parents vpls = { store.x.data(), store.y.data(), store.z.data(), store.nx.data(), store.ny.data(), store.nz.data(), nullptr, nullptr, store.perBounce };
+	buildRays(store, vpls, firstBounce, store.size, rDelta, rays);
+}
+
+namespace {
+//Slab test against the ray's whole length, o.w holds the distance to the parent
+bool crosses(const RR::ray& r, const glm::vec3& min, const glm::vec3& max) {
+	float tNear = 0;
+	float tFar = r.o.w;
+	for (int a = 0; a < 3; ++a) {
+		float o = a == 0 ? r.o.x : a == 1 ? r.o.y : r.o.z;
+		float d = a == 0 ? r.d.x : a == 1 ? r.d.y : r.d.z;
+		if (std::abs(d) < 1e-12f) {
+			if (o < min[a] || o > max[a])
+				return false;
+			continue;
+		}
+		float t0 = (min[a] - o) / d;
+		float t1 = (max[a] - o) / d;
+		tNear = std::max(tNear, std::min(t0, t1));
+		tFar = std::min(tFar, std::max(t0, t1));
+		if (tNear > tFar)
+			return false;
+	}
+	return true;
+}
+}
+
+//Static geometry cannot change a ray's answer, only moving geometry inside the box can
+void VPL::markCrossing(Store& store, const std::vector<RR::ray>& rays, const glm::vec3& min, const glm::vec3& max) {
+	for (unsigned int w = 0; w < store.valid.size(); ++w) {
+		uint64_t candidates = store.valid[w] & ~store.dirty[w];
+		while (candidates) {
+			unsigned int bit = __builtin_ctzll(candidates);
+			candidates &= candidates - 1;
+			if (crosses(rays[w * 64 + bit], min, max))
+				store.dirty[w] |= uint64_t(1) << bit;
+		}
+	}
+}
+
+//Moves the rays of valid dirty VPLs to the front, indices maps each of them back to its VPL
+unsigned int VPL::compactDirty(const Store& store, std::vector<RR::ray>& rays, std::vector<unsigned int>& indices) {
+	indices.resize(store.size);
+	unsigned int n = 0;
+	for (unsigned int w = 0; w < store.valid.size(); ++w) {
+		uint64_t traced = store.valid[w] & store.dirty[w];
+		while (traced) {
+			unsigned int i = w * 64 + __builtin_ctzll(traced);
+			traced &= traced - 1;
+			rays[n] = rays[i];
+			indices[n] = i;
+			n++;
+		}
+	}
+	return n;
+}
+
+//Returns the number of VPLs newly invalidated by an occluded ray or by leaving their light's cone or quad
+unsigned int VPL::invalidate(Store& store, const int* occlus) {
+	unsigned int firstBounce = std::min(store.perBounce, store.size);
+	unsigned int noOfInvalidated = 0;
+	//Lane groups never straddle a 64 bit word
+	for (unsigned int i = 0; i < store.size; i += VPL_LANES) {
+		unsigned int lanes = std::min(store.size - i, (unsigned int)VPL_LANES);
+		unsigned int bits = 0;
+#ifdef __SSE2__
+		if (lanes == VPL_LANES) {
+			__m128i occlu = _mm_loadu_si128((const __m128i*)(occlus + i));
+			bits = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(occlu, _mm_set1_epi32(-1)))) & 0xF;
+		}
+		else
+#endif
+		for (unsigned int k = 0; k < lanes; ++k)
+			bits |= (occlus[i + k] != -1) << k;
+		if (i < firstBounce)
+			bits |= getOutside(store, i) & ((1u << std::min(firstBounce - i, (unsigned int)VPL_LANES)) - 1);
+		bits &= (1u << lanes) - 1;
+
+		uint64_t dropped = uint64_t(bits) << (i % 64);
+		uint64_t& word = store.valid[i / 64];
+		noOfInvalidated += __builtin_popcountll(word & dropped);
+		word &= ~dropped;
+	}
+	return noOfInvalidated;
+}
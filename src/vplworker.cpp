@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#define USE_OPENCL 1
+#include "radeon_rays_cl.h"
+#include "vplworker.h"
+#include "triplebuffer.h"
+#include "model.h"
+#include "sampler.h"
+#include "vpl.h"
+
+namespace RR = RadeonRays;
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+unsigned int noOfVPLs;
+unsigned int noOfVPLBounces;
+unsigned int iHistorySize;
+std::atomic<unsigned int> maxVPLGenPerFrame;
+float rDelta;
+bool dirtyTracking;
+
+bool threaded;
+float vplRate;
+std::thread worker;
+std::atomic<bool> running;
+std::mutex wakeMutex;
+std::condition_variable wake;
+
+TripleBuffer<VPLWorker::Job> jobs;
+TripleBuffer<VPLWorker::Result> results;
+
+cl_context clContext;
+cl_device_id clDevice;
+cl_command_queue workerQueue;
+RR::IntersectionApi* intersectionApi;
+
+//Only ever touched by whichever thread runs step()
+VPL::Store store;
+std::vector<Light> vpls;
+std::vector<RR::ray> rays;
+std::vector<unsigned int> rayIndices;
+std::vector<int> occlus;
+float validatedTime;
+Model::Surfaces surfaces;
+std::vector<Sampler::Sequence> sequences;
+int currVPL;
+unsigned int noOfInvalid;
+unsigned int generation;
+
+float getMilliseconds(Clock::time_point start) {
+	return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
+
+void step(const VPLWorker::Job& job) {
+	VPLWorker::Result& result = results.back();
+	unsigned int noOfLights = job.pls.size();
+	if (threaded)
+		Model::updateAttached(intersectionApi, job.modelTime);
+
+	Clock::time_point start = Clock::now();
+	unsigned int lihi = job.historyIndex % iHistorySize;
+	if (noOfInvalid < maxVPLGenPerFrame) {
+		for (int i = 0; i < noOfVPLs / iHistorySize; ++i) {
+			if (VPL::isValid(store, (lihi * noOfVPLs / iHistorySize) + i)) {
+				VPL::setValid(store, (lihi * noOfVPLs / iHistorySize) + i, false);
+				noOfInvalid++;
+			}
+		}
+	}
+
+	VPL::setLights(store, job.pls, job.plexs);
+	VPL::buildValidationRays(store, rDelta, rays);
+
+	//Only rays that moved or that the dynamic meshes may have crossed since the last validation are traced again
+	unsigned int noOfRays = vpls.size();
+	if (dirtyTracking) {
+		glm::vec3 min, max;
+		if (job.modelTime != validatedTime && Model::getDynamicBounds(validatedTime, job.modelTime, min, max))
+			VPL::markCrossing(store, rays, min, max);
+		validatedTime = job.modelTime;
+		noOfRays = VPL::compactDirty(store, rays, rayIndices);
+	}
+
+	std::fill(occlus.begin(), occlus.end(), -1);
+	result.noOfValidationOccluded = 0;
+	if (noOfRays > 0) {
+		RR::Buffer* ray_buffer = intersectionApi->CreateBuffer(noOfRays * sizeof(RR::ray), rays.data());
+		RR::Buffer* occlu_buffer = intersectionApi->CreateBuffer(noOfRays * sizeof(int), nullptr);
+
+		intersectionApi->QueryOcclusion(ray_buffer, noOfRays, occlu_buffer, nullptr, nullptr);
+
+		int* traced = nullptr;
+		RR::Event* e = nullptr;
+		intersectionApi->MapBuffer(occlu_buffer, RR::kMapRead, 0, noOfRays * sizeof(int), (void**)& traced, &e);
+
+		e->Wait();
+		intersectionApi->DeleteEvent(e);
+		e = nullptr;
+
+		if (dirtyTracking) {
+			for (unsigned int i = 0; i < noOfRays; ++i)
+				occlus[rayIndices[i]] = traced[i];
+		}
+		else {
+			std::copy(traced, traced + noOfRays, occlus.begin());
+		}
+		result.noOfValidationOccluded = std::count_if(traced, traced + noOfRays, [](int occlu) { return occlu != -1; });
+
+		intersectionApi->DeleteBuffer(occlu_buffer);
+		intersectionApi->DeleteBuffer(ray_buffer);
+	}
+
+	noOfInvalid += VPL::invalidate(store, occlus.data());
+	VPL::clearDirty(store);
+	result.noOfValidationRays = noOfRays;
+
+	result.validationTime = getMilliseconds(start);
+	start = Clock::now();
+
+	unsigned int noOfVPLSShot = 0;
+	unsigned int noOfVPLSTried = 0;
+	while (noOfVPLSShot < maxVPLGenPerFrame && noOfVPLSTried < noOfVPLs) {
+		noOfVPLSTried++;
+		currVPL = (currVPL + 1) % noOfVPLs;
+		if (!VPL::isValid(store, currVPL)) {
+			Light pvpl = job.pls[currVPL % noOfLights];
+			float hltn[SAMPLER_MAX_DIMENSIONS];
+			Sampler::next(sequences[currVPL % noOfLights], 3, hltn);
+			RR::ray r;
+			r.extra.x = currVPL;
+			r.extra.y = -(1 + (currVPL % noOfLights));
+			if (currVPL >= noOfVPLs / noOfVPLBounces) {
+				r.extra.y = currVPL - (noOfVPLs / noOfVPLBounces);
+				if (!VPL::isValid(store, r.extra.y)) {
+					continue;
+				}
+				pvpl = vpls[r.extra.y];
+				glm::vec3 dir = glm::vec3(2 * hltn[0] - 1, 2 * hltn[1] - 1, 2 * hltn[2] - 1);
+				glm::vec3 normal = glm::vec3(pvpl.normal.x, pvpl.normal.y, pvpl.normal.z);
+				dir = glm::faceforward(-dir, dir, normal);
+				r.o = RR::float4(pvpl.position.x, pvpl.position.y, pvpl.position.z, 1000.f);
+				r.d = RR::float3(dir.x, dir.y, dir.z);
+			}
+			else {
+				const LightExtra& plex = job.plexs[currVPL % noOfLights];
+				if (plex.type == 1) {//slightly out of bounds
+					hltn[0] = (plex.angle * (2 * hltn[0] - 1)) + acos(pvpl.normal.z);
+					hltn[1] = (plex.angle * (2 * hltn[1] - 1)) + atan(pvpl.normal.y / pvpl.normal.x);
+					r.o = RR::float4(pvpl.position.x, pvpl.position.y, pvpl.position.z, 1000.f);
+					r.d.x = sin(hltn[0]) * cos(hltn[1]);
+					r.d.y = sin(hltn[0]) * sin(hltn[1]);
+					r.d.z = cos(hltn[0]);
+				}
+				else if (plex.type == 2) {
+					r.o = RR::float4(pvpl.position.x, pvpl.position.y, pvpl.position.z, 1000.f);
+					r.o.x += (2 * hltn[0] - 1) * plex.quad.x;
+					r.o.z += (2 * hltn[1] - 1) * plex.quad.y;
+					r.d = RR::float3(pvpl.normal.x, pvpl.normal.y, pvpl.normal.z);
+				}
+				else {
+					r.o = RR::float4(pvpl.position.x, pvpl.position.y, pvpl.position.z, 1000.f);
+					r.d = RR::float3(2 * hltn[0] - 1, 2 * hltn[1] - 1, 2 * hltn[2] - 1);
+				}
+			}
+			rays[noOfVPLSShot] = r;
+			noOfVPLSShot++;
+		}
+	}
+
+	result.noOfShootingRays = noOfVPLSShot;
+	result.noOfShootingHits = 0;
+	if (noOfVPLSShot > 0) {
+		RR::Buffer* ray_buffer = intersectionApi->CreateBuffer(noOfVPLSShot * sizeof(RR::ray), rays.data());
+		RR::Buffer* isect_buffer = intersectionApi->CreateBuffer(noOfVPLSShot * sizeof(RR::Intersection), nullptr);
+		intersectionApi->QueryIntersection(ray_buffer, noOfVPLSShot, isect_buffer, nullptr, nullptr);
+
+		RR::Event* e = nullptr;
+		RR::Intersection* isects = nullptr;
+		intersectionApi->MapBuffer(isect_buffer, RR::kMapRead, 0, noOfVPLSShot * sizeof(RR::Intersection), (void**)& isects, &e);
+
+		e->Wait();
+		intersectionApi->DeleteEvent(e);
+		e = nullptr;
+
+		Model::getSurfaces(isects, rays.data(), noOfVPLSShot, surfaces);
+		for (int i = 0; i < noOfVPLSShot; ++i) {
+			const RR::ray& ray = rays[i];
+			const RR::Intersection& isect = isects[i];
+			if (isect.shapeid != -1) {
+				result.noOfShootingHits++;
+				Light pvpl;
+				int vplIndex = ray.extra.x;
+				if (ray.extra.y >= 0) {
+					pvpl = vpls[ray.extra.y];
+				}
+				else {
+					pvpl = job.pls[-(1 + ray.extra.y)];
+				}
+				Light vpl;
+				float distance = isect.uvwt.w;
+				glm::vec4 normal = glm::vec4(surfaces.nx[i], surfaces.ny[i], surfaces.nz[i], 0);
+				vpl.normal = normal;
+				vpl.position = glm::vec4(
+					surfaces.px[i] + (normal.x * rDelta),
+					surfaces.py[i] + (normal.y * rDelta),
+					surfaces.pz[i] + (normal.z * rDelta),
+					1
+				);
+				glm::vec4 incident = glm::normalize(pvpl.position - vpl.position);
+				vpl.diffuse = glm::vec4(surfaces.r[i], surfaces.g[i], surfaces.b[i], 1);
+				vpl.diffuse *= pvpl.diffuse * glm::max(glm::dot(normal, incident), 0.f) / (PI);
+				vpl.specular = glm::vec4(0, 0, 0, 1);
+				float pathDist = 0;
+				if (ray.extra.y >= 0) {
+					pathDist = store.pathDist[ray.extra.y] + distance;
+					float attenuation = 1 / (1 + pathDist * pathDist);
+					vpl.diffuse *= attenuation;
+					vpl.specular *= attenuation;
+				}
+				else {
+					vpl.diffuse *= 10 * noOfVPLBounces / (float)noOfVPLs;
+					vpl.specular *= 10 * noOfVPLBounces / (float)noOfVPLs;
+				}
+				vpls[vplIndex] = vpl;
+				VPL::set(store, vplIndex, vpl, pathDist);
+				VPL::setValid(store, vplIndex, true);
+				noOfInvalid--;
+			}
+		}
+
+		intersectionApi->DeleteBuffer(isect_buffer);
+		intersectionApi->DeleteBuffer(ray_buffer);
+
+		generation++;
+	}
+
+	result.shootingTime = getMilliseconds(start);
+	result.vpls = vpls;
+	result.generation = generation;
+	result.noOfInvalid = noOfInvalid;
+	results.publish();
+}
+
+//Without a rate every job is worked once, with one the newest job is reworked every period until a fresher one arrives
+void run() {
+	workerQueue = clCreateCommandQueueWithProperties(clContext, clDevice, NULL, NULL);
+	intersectionApi = RR::CreateFromOpenClContext(clContext, clDevice, workerQueue);
+	intersectionApi->SetOption("bvh.type", "hlbvh");
+	intersectionApi->SetOption("bvh.force2level", 1);
+	//Submit publishes before starting the thread, so the first job is there to place the dynamic meshes
+	bool pending = jobs.update();
+	Model::attach(intersectionApi, jobs.front().modelTime);
+
+	Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(vplRate > 0 ? 1 / vplRate : 0));
+	Clock::time_point next = Clock::now();
+	while (running) {
+		if (jobs.update())
+			pending = true;
+		if (!pending || Clock::now() < next) {
+			//Submit does not take the lock, a missed notify costs at most a millisecond
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wake.wait_until(lock, pending ? next : Clock::now() + std::chrono::milliseconds(1));
+			continue;
+		}
+		step(jobs.front());
+		pending = vplRate > 0;
+		next = std::max(next + period, Clock::now() - period);
+	}
+
+	RR::IntersectionApi::Delete(intersectionApi);
+	clReleaseCommandQueue(workerQueue);
+}
+}
+
+bool VPLWorker::init(INIReader config, cl_context context, cl_device_id device, RR::IntersectionApi* sharedApi, const std::vector<Light>& pls, unsigned int vplCount, unsigned int bounces, unsigned int historySize, bool thread) {
+	noOfVPLs = vplCount;
+	noOfVPLBounces = bounces;
+	iHistorySize = historySize;
+	maxVPLGenPerFrame = config.GetInteger("renderer", "maxVPLGenPerFrame", 5);
+	rDelta = config.GetReal("renderer", "rDelta", 0.1f);
+	dirtyTracking = config.GetBoolean("renderer", "vplDirtyTracking", true);
+	vplRate = config.GetReal("renderer", "vplRate", 0);
+	threaded = thread;
+	clContext = context;
+	clDevice = device;
+	intersectionApi = threaded ? nullptr : sharedApi;
+
+	VPL::init(store, noOfVPLs, noOfVPLBounces);
+	vpls.assign(noOfVPLs, pls[0]);
+	for (unsigned int i = 0; i < noOfVPLs; ++i)
+		VPL::set(store, i, pls[0], 0);
+	rays.resize(noOfVPLs);
+	occlus.resize(noOfVPLs);
+	validatedTime = 0;
+	noOfInvalid = noOfVPLs;
+	generation = 0;
+	currVPL = 0;
+
+	//One stream per light, light 0 is unscrambled so halton matches the plain sequence from index 1000
+	std::string sampler = config.Get("renderer", "sampler", "halton");
+	unsigned int samplerType = SAMPLER_HALTON;
+	if (sampler == "sobol")
+		samplerType = SAMPLER_SOBOL;
+	else if (sampler != "halton")
+		std::cerr << "Unknown sampler " << sampler << ", using halton" << std::endl;
+	for (unsigned int i = 0; i < pls.size(); ++i)
+		sequences.push_back(Sampler::create(samplerType, i, 1000));
+	return true;
+}
+
+VPLWorker::Job& VPLWorker::getJob() {
+	return jobs.back();
+}
+
+//The thread starts on the first job, by then the meshes it copies have been loaded
+void VPLWorker::submit() {
+	if (!threaded) {
+		step(jobs.back());
+		return;
+	}
+	jobs.publish();
+	if (!worker.joinable()) {
+		running = true;
+		worker = std::thread(run);
+	}
+	wake.notify_one();
+}
+
+//Null when nothing newer than the last acquired set has been published
+const VPLWorker::Result* VPLWorker::acquire() {
+	return results.update() ? &results.front() : nullptr;
+}
+
+//Read by the next step, so a running worker picks it up without a new job
+void VPLWorker::setMaxGenPerFrame(unsigned int maxGen) {
+	maxVPLGenPerFrame = maxGen;
+}
+
+unsigned int VPLWorker::getMaxGenPerFrame() {
+	return maxVPLGenPerFrame;
+}
+
+bool VPLWorker::isThreaded() {
+	return threaded;
+}
+
+void VPLWorker::destroy() {
+	running = false;
+	wake.notify_one();
+	if (worker.joinable())
+		worker.join();
+}
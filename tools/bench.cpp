@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "halton.hpp"
+#include "light.h"
+#include "model.h"
+#include "sampler.h"
+#include "vpl.h"
+
+namespace RR = RadeonRays;
+
+#define BENCH_MIN_TIME 0.25
+#define BENCH_SEED 1337
+
+//Every heap allocation in the process is counted so each benchmark can report allocations per operation
+unsigned long long noOfAllocations = 0;
+
+void* operator new(std::size_t size) {
+	noOfAllocations++;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+//Written by every benchmark so the work cannot be optimised away
+volatile float sink;
+
+std::string filter;
+unsigned int noOfMeshes = 0;
+
+//Runs op(n) with a doubling n until it takes at least BENCH_MIN_TIME, then reports the last run per operation
+void run(const std::string& name, unsigned int param, const std::function<void(unsigned int)>& op) {
+	if (name.find(filter) == std::string::npos)
+		return;
+	op(1);
+	unsigned int n = 1;
+	double seconds = 0;
+	unsigned long long allocations = 0;
+	while (true) {
+		unsigned long long allocationsStart = noOfAllocations;
+		auto start = std::chrono::steady_clock::now();
+		op(n);
+		auto end = std::chrono::steady_clock::now();
+		allocations = noOfAllocations - allocationsStart;
+		seconds = std::chrono::duration<double>(end - start).count();
+		if (seconds >= BENCH_MIN_TIME || n >= (1u << 30))
+			break;
+		n *= 2;
+	}
+	std::cout << std::left << std::setw(28) << name << std::right << std::setw(10) << param
+		<< std::setw(14) << std::fixed << std::setprecision(1) << seconds * 1e9 / n
+		<< std::setw(14) << std::setprecision(2) << allocations / (double)n << std::endl;
+}
+
+Light makeLight(std::mt19937& rng) {
+	std::uniform_real_distribution<float> position(-10, 10);
+	std::uniform_real_distribution<float> direction(-1, 1);
+	Light light;
+	light.position = glm::vec4(position(rng), position(rng), position(rng), 1);
+	light.diffuse = glm::vec4(1);
+	light.specular = glm::vec4(1);
+	light.normal = glm::vec4(glm::normalize(glm::vec3(direction(rng), direction(rng), direction(rng)) + glm::vec3(0, 0, 0.01f)), 0);
+	return light;
+}
+
+//One mesh of noOfTriangles random triangles, lookups hit random faces so any dependence on mesh size shows
+void benchSurface(unsigned int noOfTriangles) {
+	std::mt19937 rng(BENCH_SEED);
+	std::uniform_real_distribution<float> unit(0, 1);
+	std::vector<glm::vec3> positions(noOfTriangles * 3);
+	std::vector<glm::vec3> normals(noOfTriangles * 3);
+	std::vector<glm::vec2> texCoords(noOfTriangles * 3);
+	for (unsigned int i = 0; i < positions.size(); ++i) {
+		positions[i] = glm::vec3(unit(rng), unit(rng), unit(rng));
+		normals[i] = glm::vec3(0, 1, 0);
+		texCoords[i] = glm::vec2(unit(rng), unit(rng));
+	}
+	Model::addMesh(positions, normals, texCoords, glm::vec3(0.5f));
+	unsigned int mesh = noOfMeshes++;
+
+	std::vector<unsigned int> faces(1024);
+	for (auto& face : faces)
+		face = rng() % noOfTriangles;
+
+	run("Model::getNormal", noOfTriangles, [&](unsigned int n) {
+		float total = 0;
+		for (unsigned int i = 0; i < n; ++i)
+			total += Model::getNormal(mesh, faces[i % faces.size()], 0.25f, 0.25f).y;
+		sink = total;
+	});
+	run("Model::getDiffuse", noOfTriangles, [&](unsigned int n) {
+		float total = 0;
+		for (unsigned int i = 0; i < n; ++i)
+			total += Model::getDiffuse(mesh, faces[i % faces.size()], 0.25f, 0.25f).r;
+		sink = total;
+	});
+
+	std::vector<RR::Intersection> isects(faces.size());
+	std::vector<RR::ray> rays(faces.size());
+	for (unsigned int i = 0; i < faces.size(); ++i) {
+		isects[i].shapeid = mesh;
+		isects[i].primid = faces[i];
+		isects[i].uvwt = RR::float4(0.25f, 0.25f, 0, 1);
+		rays[i].o = RR::float4(0, 0, 0, 1000.f);
+		rays[i].d = RR::float3(0, 1, 0);
+	}
+	Model::Surfaces surfaces;
+	run("Model::getSurfaces", noOfTriangles, [&](unsigned int n) {
+		float total = 0;
+		for (unsigned int i = 0; i < n; i += faces.size()) {
+			Model::getSurfaces(isects.data(), rays.data(), std::min((unsigned int)faces.size(), n - i), surfaces);
+			total += surfaces.r[0] + surfaces.ny[0];
+		}
+		sink = total;
+	});
+}
+
+//Mirrors the validation pass in renderer::update, a quad light so the quad distance runs for every first bounce
+void benchValidation(unsigned int noOfVPLs, unsigned int noOfVPLBounces) {
+	std::mt19937 rng(BENCH_SEED);
+	std::vector<Light> pls(1, makeLight(rng));
+	pls[0].normal = glm::vec4(0, -1, 0, 0);
+	std::vector<LightExtra> plexs(1);
+	plexs[0].type = 2;
+	plexs[0].quad = glm::vec2(9, 3);
+	plexs[0].angle = 0.78f;
+	std::vector<Light> vpls(noOfVPLs);
+	VPL::Store store;
+	VPL::init(store, noOfVPLs, noOfVPLBounces);
+	for (unsigned int i = 0; i < noOfVPLs; ++i) {
+		vpls[i] = makeLight(rng);
+		VPL::set(store, i, vpls[i], 0);
+	}
+	std::vector<RR::ray> rays(noOfVPLs);
+	std::vector<int> occlus(noOfVPLs);
+	for (auto& occlu : occlus)
+		occlu = rng() % 4 == 0 ? 0 : -1;
+
+	run("VPL::getQuadLightDistance", noOfVPLs, [&](unsigned int n) {
+		float total = 0;
+		for (unsigned int i = 0; i < n; ++i)
+			total += VPL::getQuadLightDistance(pls[0], vpls[i % noOfVPLs]);
+		sink = total;
+	});
+	run("VPL::buildValidationRays", noOfVPLs, [&](unsigned int n) {
+		for (unsigned int i = 0; i < n; ++i) {
+			VPL::setLights(store, pls, plexs);
+			VPL::buildValidationRays(store, 0.1f, rays);
+		}
+		sink = rays[noOfVPLs - 1].o.w;
+	});
+	run("VPL::invalidate", noOfVPLs, [&](unsigned int n) {
+		unsigned int total = 0;
+		for (unsigned int i = 0; i < n; ++i) {
+			std::fill(store.valid.begin(), store.valid.end(), ~uint64_t(0));
+			total += VPL::invalidate(store, occlus.data());
+		}
+		sink = total;
+	});
+	//Steady state with the dynamic meshes sweeping a box through the middle of the scene
+	std::vector<unsigned int> indices;
+	run("VPL::markCrossing+compact", noOfVPLs, [&](unsigned int n) {
+		unsigned int total = 0;
+		for (unsigned int i = 0; i < n; ++i) {
+			std::fill(store.valid.begin(), store.valid.end(), ~uint64_t(0));
+			VPL::clearDirty(store);
+			VPL::buildValidationRays(store, 0.1f, rays);
+			VPL::markCrossing(store, rays, glm::vec3(-1, -1, -1), glm::vec3(1, 1, 1));
+			total += VPL::compactDirty(store, rays, indices);
+		}
+		sink = total;
+	});
+}
+
+//The uniform names renderer::render rebuilds for every light and VPL each frame
+void benchUniformNames(unsigned int noOfVPLs) {
+	run("uniform names", noOfVPLs, [&](unsigned int n) {
+		size_t total = 0;
+		for (unsigned int f = 0; f < n; ++f) {
+			for (unsigned int i = 0; i < noOfVPLs; ++i) {
+				total += ("vpls[" + std::to_string(i) + "].position").size();
+				total += ("vpls[" + std::to_string(i) + "].diffuse").size();
+				total += ("vpls[" + std::to_string(i) + "].specular").size();
+				total += ("vpls[" + std::to_string(i) + "].normal").size();
+			}
+		}
+		sink = total;
+	});
+}
+
+void benchHalton() {
+	run("halton", 3, [&](unsigned int n) {
+		double total = 0;
+		for (unsigned int i = 0; i < n; ++i) {
+			double* hltn = halton(1000 + i, 3);
+			total += hltn[0] + hltn[1] + hltn[2];
+			delete[] hltn;
+		}
+		sink = total;
+	});
+	run("halton", 2, [&](unsigned int n) {
+		double total = 0;
+		for (unsigned int i = 0; i < n; ++i) {
+			double* hltn = halton(1000 + i, 2);
+			total += hltn[0] + hltn[1];
+			delete[] hltn;
+		}
+		sink = total;
+	});
+}
+
+//The VPL shooting loop draws one 3D sample per attempt, generate() is the batched form
+void benchSampler(unsigned int type, const std::string& name) {
+	run(name, 3, [&](unsigned int n) {
+		Sampler::Sequence sequence = Sampler::create(type, 1, 1000);
+		float total = 0;
+		float sample[SAMPLER_MAX_DIMENSIONS];
+		for (unsigned int i = 0; i < n; ++i) {
+			Sampler::next(sequence, 3, sample);
+			total += sample[0] + sample[1] + sample[2];
+		}
+		sink = total;
+	});
+	std::vector<float> samples(4096 * 3);
+	run(name + " batch", 3, [&](unsigned int n) {
+		Sampler::Sequence sequence = Sampler::create(type, 1, 1000);
+		float total = 0;
+		for (unsigned int i = 0; i < n; i += 4096) {
+			Sampler::generate(sequence, std::min(4096u, n - i), 3, samples.data());
+			total += samples[0];
+		}
+		sink = total;
+	});
+}
+
+int main(int argc, char** args) {
+	if (argc >= 2)
+		filter = args[1];
+
+	std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(10) << "param"
+		<< std::setw(14) << "ns/op" << std::setw(14) << "allocs/op" << std::endl;
+
+	benchHalton();
+	benchSampler(SAMPLER_HALTON, "sampler halton");
+	benchSampler(SAMPLER_SOBOL, "sampler sobol");
+	for (unsigned int noOfTriangles : { 1024, 65536, 1048576 })
+		benchSurface(noOfTriangles);
+	for (unsigned int noOfVPLs : { 64, 512, 4096, 16384 })
+		benchValidation(noOfVPLs, 3);
+	for (unsigned int noOfVPLs : { 64, 512, 4096 })
+		benchUniformNames(noOfVPLs);
+
+	return 0;
+}
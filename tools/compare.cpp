@@ -0,0 +1,132 @@
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define SSIM_WINDOW 8
+
+struct Image {
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;
+};
+
+bool readPPM(const char* path, Image& image) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open " << path << std::endl;
+		return false;
+	}
+	std::string magic;
+	int maxValue;
+	file >> magic >> image.width >> image.height >> maxValue;
+	file.get();
+	if (magic != "P6" || maxValue != 255) {
+		std::cerr << path << " is not an 8-bit binary PPM" << std::endl;
+		return false;
+	}
+	image.pixels.resize(image.width * image.height * 3);
+	file.read(reinterpret_cast<char*>(image.pixels.data()), image.pixels.size());
+	return file.gcount() == (std::streamsize)image.pixels.size();
+}
+
+float srgbToLinear(float c) {
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float luminance(const Image& image, int i) {
+	return 0.2126f * image.pixels[i * 3] + 0.7152f * image.pixels[i * 3 + 1] + 0.0722f * image.pixels[i * 3 + 2];
+}
+
+void toLab(const Image& image, int i, float lab[3]) {
+	float r = srgbToLinear(image.pixels[i * 3] / 255.f);
+	float g = srgbToLinear(image.pixels[i * 3 + 1] / 255.f);
+	float b = srgbToLinear(image.pixels[i * 3 + 2] / 255.f);
+	float xyz[3] = {
+		(0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.9505f,
+		0.2126f * r + 0.7152f * g + 0.0722f * b,
+		(0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.089f
+	};
+	for (int c = 0; c < 3; ++c)
+		xyz[c] = xyz[c] > 0.008856f ? std::cbrt(xyz[c]) : 7.787f * xyz[c] + 16.f / 116.f;
+	lab[0] = 116 * xyz[1] - 16;
+	lab[1] = 500 * (xyz[0] - xyz[1]);
+	lab[2] = 200 * (xyz[1] - xyz[2]);
+}
+
+double rmse(const Image& a, const Image& b) {
+	double sum = 0;
+	for (size_t i = 0; i < a.pixels.size(); ++i) {
+		double d = (a.pixels[i] - b.pixels[i]) / 255.0;
+		sum += d * d;
+	}
+	return std::sqrt(sum / a.pixels.size());
+}
+
+//Mean SSIM over non-overlapping luminance windows
+double ssim(const Image& a, const Image& b) {
+	const double c1 = (0.01 * 255) * (0.01 * 255);
+	const double c2 = (0.03 * 255) * (0.03 * 255);
+	const int n = SSIM_WINDOW * SSIM_WINDOW;
+	double sum = 0;
+	int windows = 0;
+	for (int wy = 0; wy + SSIM_WINDOW <= a.height; wy += SSIM_WINDOW) {
+		for (int wx = 0; wx + SSIM_WINDOW <= a.width; wx += SSIM_WINDOW) {
+			double meanA = 0, meanB = 0;
+			for (int y = wy; y < wy + SSIM_WINDOW; ++y)
+				for (int x = wx; x < wx + SSIM_WINDOW; ++x) {
+					meanA += luminance(a, y * a.width + x);
+					meanB += luminance(b, y * a.width + x);
+				}
+			meanA /= n;
+			meanB /= n;
+			double varA = 0, varB = 0, cov = 0;
+			for (int y = wy; y < wy + SSIM_WINDOW; ++y)
+				for (int x = wx; x < wx + SSIM_WINDOW; ++x) {
+					double da = luminance(a, y * a.width + x) - meanA;
+					double db = luminance(b, y * a.width + x) - meanB;
+					varA += da * da;
+					varB += db * db;
+					cov += da * db;
+				}
+			varA /= n - 1;
+			varB /= n - 1;
+			cov /= n - 1;
+			sum += ((2 * meanA * meanB + c1) * (2 * cov + c2)) / ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+			windows++;
+		}
+	}
+	return windows > 0 ? sum / windows : 1;
+}
+
+//Simplified FLIP, the mean HyAB colour distance in CIELAB without the spatial filters, normalized to [0,1]
+double flip(const Image& a, const Image& b) {
+	const double maxDistance = 100 + std::sqrt(2.0) * 128;
+	double sum = 0;
+	int count = a.width * a.height;
+	for (int i = 0; i < count; ++i) {
+		float la[3], lb[3];
+		toLab(a, i, la);
+		toLab(b, i, lb);
+		double distance = std::abs(la[0] - lb[0]) + std::sqrt((la[1] - lb[1]) * (la[1] - lb[1]) + (la[2] - lb[2]) * (la[2] - lb[2]));
+		sum += std::fmin(distance / maxDistance, 1.0);
+	}
+	return count > 0 ? sum / count : 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " reference.ppm candidate.ppm" << std::endl;
+		return 1;
+	}
+	Image reference, candidate;
+	if (!readPPM(argv[1], reference) || !readPPM(argv[2], candidate))
+		return 1;
+	if (reference.width != candidate.width || reference.height != candidate.height) {
+		std::cerr << "Image sizes differ" << std::endl;
+		return 1;
+	}
+	std::cout << rmse(reference, candidate) << "," << ssim(reference, candidate) << "," << flip(reference, candidate) << std::endl;
+	return 0;
+}